@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2013 Vadim Kochan <vadim4j@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Draining of a Netlink socket: bursts of datagrams are sent to a socket of
+ * NETLINK_USERSOCK, which needs no privileges, and nl_sock_drain() receives
+ * each burst after one poll() wakeup, with recvmmsg() batches of
+ * NL_BATCH_MAX datagrams and of one datagram.
+ *
+ * The syscalls of the receive side are counted by the wrappers of recv() and
+ * recvmmsg() below, the ones of netlink.c are linked to them, and the poll()
+ * calls of the bench loop.
+ *
+ * drain_bench [BURSTS]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "netlink.h"
+#include "utils.h"
+
+#define BENCH_MSG_SIZE 64
+
+static unsigned long bench_syscalls = 0;
+static unsigned long bench_msgs = 0;
+
+ssize_t recv(int sock, void *buf, size_t len, int flags)
+{
+    bench_syscalls++;
+    return syscall(SYS_recvfrom, sock, buf, len, flags, NULL, NULL);
+}
+
+int recvmmsg(int sock, struct mmsghdr *msgs, unsigned int vlen, int flags,
+    struct timespec *timeout)
+{
+    bench_syscalls++;
+    return syscall(SYS_recvmmsg, sock, msgs, vlen, flags, timeout);
+}
+
+static double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_recv(nl_sock_t *nl_sock, void *buf, int len, int nsid)
+{
+    bench_msgs++;
+}
+
+static int bench_send(int sock, struct sockaddr_nl *dst, int burst)
+{
+    char buf[BENCH_MSG_SIZE];
+    struct nlmsghdr *msg = (struct nlmsghdr *)buf;
+    int i;
+
+    memset(buf, 0, sizeof(buf));
+    msg->nlmsg_len = sizeof(buf);
+    msg->nlmsg_type = NLMSG_MIN_TYPE;
+
+    for (i = 0; i < burst; i++)
+    {
+        msg->nlmsg_seq = i;
+
+        if (sendto(sock, buf, sizeof(buf), 0, (struct sockaddr *)dst,
+                    sizeof(*dst)) < 0)
+        {
+            fprintf(stderr, "Can't send: %s\n", strerror(errno));
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int bench_run(int sock, nl_sock_t *nl_sock, struct sockaddr_nl *dst,
+    int batch, int burst, int bursts)
+{
+    struct pollfd pfd = { .fd = nl_sock->sock, .events = POLLIN };
+    unsigned long wakeups = 0, polls = 0;
+    double start, elapsed = 0;
+    int i;
+
+    nl_sock->batch = batch;
+    bench_msgs = 0;
+    bench_syscalls = 0;
+
+    for (i = 0; i < bursts; i++)
+    {
+        if (bench_send(sock, dst, burst))
+            return -1;
+
+        start = bench_now();
+
+        /* the last poll() finds the socket drained */
+        for (;;)
+        {
+            polls++;
+
+            if (poll(&pfd, 1, 0) <= 0)
+                break;
+
+            wakeups++;
+            nl_sock_drain(nl_sock, bench_recv, NULL);
+        }
+
+        elapsed += bench_now() - start;
+    }
+
+    if (bench_msgs != (unsigned long)burst * bursts)
+    {
+        fprintf(stderr, "received %lu of %lu datagrams\n", bench_msgs,
+                (unsigned long)burst * bursts);
+        return -1;
+    }
+
+    printf("burst %3d, batch %2d: %.3f wakeups, %.3f syscalls, %.1f ns "
+            "per datagram\n", burst, batch, (double)wakeups / bench_msgs,
+            (double)(bench_syscalls + polls) / bench_msgs, elapsed * 1e9 / bench_msgs);
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    static const int bursts_sizes[] = { 1, 8, 64, 256 };
+    int bursts = argc > 1 ? atoi(argv[1]) : 2000;
+    struct sockaddr_nl dst;
+    socklen_t len = sizeof(dst);
+    nl_sock_t *nl_sock;
+    int i, sock, err = 0;
+
+    if (bursts <= 0)
+    {
+        fprintf(stderr, "usage: %s [BURSTS]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (!(nl_sock = nl_sock_create(NETLINK_USERSOCK, 0)))
+        return EXIT_FAILURE;
+
+    /* a whole burst is queued before it is drained */
+    nl_sock_rcvbuf_set(nl_sock, 4 * 1024 * 1024);
+
+    if (getsockname(nl_sock->sock, (struct sockaddr *)&dst, &len) ||
+            (sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC,
+                           NETLINK_USERSOCK)) < 0)
+    {
+        fprintf(stderr, "Can't open Netlink socket: %s\n", strerror(errno));
+        nl_sock_free(nl_sock);
+        return EXIT_FAILURE;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(bursts_sizes) && !err; i++)
+    {
+        err = bench_run(sock, nl_sock, &dst, NL_BATCH_MAX, bursts_sizes[i],
+                bursts) ||
+            bench_run(sock, nl_sock, &dst, 1, bursts_sizes[i], bursts);
+    }
+
+    /* all the buffers are freed */
+    nl_sock->batch = NL_BATCH_MAX;
+    nl_sock_free(nl_sock);
+    close(sock);
+
+    return err ? EXIT_FAILURE : 0;
+}
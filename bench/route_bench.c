@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2013 Vadim Kochan <vadim4j@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Route churn: synthetic RTM_NEWROUTE and RTM_DELROUTE messages of a full
+ * reconverge (add, move to the other gateway, delete) are passed to the RT
+ * Netlink handler as they come from the socket, once summed up by
+ * ROUTESUMMARY and once sent as the event of each route. No socket is opened,
+ * so no privileges are needed.
+ *
+ * The handler is built in to reach its static functions.
+ *
+ * route_bench [ROUTES]
+ */
+
+#include "rtnl_handler.c"
+
+#include <time.h>
+
+#define BENCH_GATEWAYS 16
+#define BENCH_MSG_SIZE 128
+#define BENCH_ROUNDS 3
+
+static unsigned int bench_sums = 0;
+
+static double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_attr_put(struct nlmsghdr *msg, int type, void *data, int len)
+{
+    struct rtattr *rta = (struct rtattr *)((char *)msg +
+            NLMSG_ALIGN(msg->nlmsg_len));
+
+    rta->rta_type = type;
+    rta->rta_len = RTA_LENGTH(len);
+    memcpy(RTA_DATA(rta), data, len);
+    msg->nlmsg_len = NLMSG_ALIGN(msg->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+}
+
+/* 10.x.y.z/32 via 192.168.0.g of the interface g + 1, as a BGP feed gives */
+static void bench_route_make(struct nlmsghdr *msg, int type, int i, int gw)
+{
+    struct rtmsg *rtm = (struct rtmsg *)NLMSG_DATA(msg);
+    unsigned int dst = htonl(0x0a000000 + i);
+    unsigned int gateway = htonl(0xc0a80000 + gw);
+    unsigned int table = RT_TABLE_MAIN, priority = 20;
+    int oif = gw + 1;
+
+    memset(msg, 0, BENCH_MSG_SIZE);
+    msg->nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+    msg->nlmsg_type = type;
+
+    rtm->rtm_family = AF_INET;
+    rtm->rtm_dst_len = 32;
+    rtm->rtm_table = RT_TABLE_MAIN;
+    rtm->rtm_protocol = RTPROT_BGP;
+    rtm->rtm_scope = RT_SCOPE_UNIVERSE;
+    rtm->rtm_type = RTN_UNICAST;
+
+    bench_attr_put(msg, RTA_TABLE, &table, sizeof(table));
+    bench_attr_put(msg, RTA_DST, &dst, sizeof(dst));
+    bench_attr_put(msg, RTA_PRIORITY, &priority, sizeof(priority));
+    bench_attr_put(msg, RTA_GATEWAY, &gateway, sizeof(gateway));
+    bench_attr_put(msg, RTA_OIF, &oif, sizeof(oif));
+}
+
+static void bench_sum_count(rtnl_summary_t *sum)
+{
+    bench_sums++;
+}
+
+static double bench_phase(char *msgs, int routes)
+{
+    double start = bench_now();
+    int i;
+
+    for (i = 0; i < routes; i++)
+    {
+        rtnl_msg_handle((struct nlmsghdr *)&msgs[i * BENCH_MSG_SIZE],
+                RTNL_NOTIFY, 0);
+    }
+
+    return (bench_now() - start) * 1e9 / routes;
+}
+
+/* the best of the rounds is kept, the first ones grow the heap */
+static void bench_run(char *msgs[3], int routes, int summary, double ns[3])
+{
+    double t;
+    int i;
+
+    rtnl_groups = RTMGRP_IPV4_ROUTE;
+    rtnl_summary_groups = summary ? RTMGRP_IPV4_ROUTE : 0;
+    rtnl_event_groups = summary ? 0 : RTMGRP_IPV4_ROUTE;
+
+    if (summary)
+        bench_sums = 0;
+
+    for (i = 0; i < 3; i++)
+    {
+        t = bench_phase(msgs[i], routes);
+        rtnl_summary_flush(bench_sum_count);
+
+        if (!ns[i] || t < ns[i])
+            ns[i] = t;
+    }
+
+    rtnl_state_cleanup();
+}
+
+static void bench_print(char *name, double ns[3], unsigned int events)
+{
+    static char *phases[] = { "add", "change", "del" };
+    int i;
+
+    printf("%-8s", name);
+
+    for (i = 0; i < 3; i++)
+        printf(" %s %.1f ns/route,", phases[i], ns[i]);
+
+    printf(" %u events\n", events);
+}
+
+int main(int argc, char **argv)
+{
+    int routes = argc > 1 ? atoi(argv[1]) : 100000;
+    double summary[3] = { 0 }, events[3] = { 0 };
+    char *msgs[3];
+    int i;
+
+    if (routes <= 0)
+    {
+        fprintf(stderr, "usage: %s [ROUTES]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    for (i = 0; i < 3; i++)
+        msgs[i] = (char *)malloc((size_t)routes * BENCH_MSG_SIZE);
+
+    /* the change moves each route to the next gateway */
+    for (i = 0; i < routes; i++)
+    {
+        bench_route_make((struct nlmsghdr *)&msgs[0][i * BENCH_MSG_SIZE],
+                RTM_NEWROUTE, i, i % BENCH_GATEWAYS);
+        bench_route_make((struct nlmsghdr *)&msgs[1][i * BENCH_MSG_SIZE],
+                RTM_NEWROUTE, i, (i + 1) % BENCH_GATEWAYS);
+        bench_route_make((struct nlmsghdr *)&msgs[2][i * BENCH_MSG_SIZE],
+                RTM_DELROUTE, i, (i + 1) % BENCH_GATEWAYS);
+    }
+
+    /* no rule is loaded, the events are built but nothing matches them */
+    poll_timer_init(&rtnl_summary_timer, on_summary_timer, NULL);
+    rtnl_attr_fields_init();
+    rtnl_summary_need = rtnl_fields_mask(RTM_NEWROUTE, rtnl_summary_keys);
+
+    printf("%d routes, %d gateways\n", routes, BENCH_GATEWAYS);
+
+    for (i = 0; i < BENCH_ROUNDS; i++)
+    {
+        bench_run(msgs, routes, 1, summary);
+        bench_run(msgs, routes, 0, events);
+    }
+
+    bench_print("summary", summary, bench_sums);
+    bench_print("events", events, 3 * routes);
+
+    poll_timer_del(&rtnl_summary_timer);
+
+    for (i = 0; i < 3; i++)
+        free(msgs[i]);
+
+    return 0;
+}
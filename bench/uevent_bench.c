@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2013 Vadim Kochan <vadim4j@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Parser of the uevents: the splitter which udev_handle() used before
+ * uevent_parse() against uevent_parse() on a fixed corpus of kernel uevents.
+ *
+ * uevent_bench [ROUNDS]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "defs.h"
+#include "key_value.h"
+#include "uevent.h"
+#include "utils.h"
+
+#define UEVENT_MSG(s) { s, sizeof(s) - 1 }
+
+static struct
+{
+    char *msg;
+    int len;
+} corpus[] = {
+    UEVENT_MSG("add@/devices/pci0000:00/0000:00:14.0/usb2/2-1/2-1:1.0/host6/"
+            "target6:0:0/6:0:0:0/block/sdb\0"
+            "ACTION=add\0"
+            "DEVPATH=/devices/pci0000:00/0000:00:14.0/usb2/2-1/2-1:1.0/host6/"
+            "target6:0:0/6:0:0:0/block/sdb\0"
+            "SUBSYSTEM=block\0MAJOR=8\0MINOR=16\0DEVNAME=sdb\0"
+            "DEVTYPE=disk\0DISKSEQ=12\0SEQNUM=4711\0"),
+    UEVENT_MSG("add@/devices/pci0000:00/0000:00:14.0/usb2/2-1/2-1:1.0/host6/"
+            "target6:0:0/6:0:0:0/block/sdb/sdb1\0"
+            "ACTION=add\0"
+            "DEVPATH=/devices/pci0000:00/0000:00:14.0/usb2/2-1/2-1:1.0/host6/"
+            "target6:0:0/6:0:0:0/block/sdb/sdb1\0"
+            "SUBSYSTEM=block\0MAJOR=8\0MINOR=17\0DEVNAME=sdb1\0"
+            "DEVTYPE=partition\0DISKSEQ=12\0PARTN=1\0PARTNAME=EFI\0"
+            "SEQNUM=4712\0"),
+    UEVENT_MSG("add@/devices/pci0000:00/0000:00:14.0/usb2/2-1\0"
+            "ACTION=add\0DEVPATH=/devices/pci0000:00/0000:00:14.0/usb2/2-1\0"
+            "SUBSYSTEM=usb\0MAJOR=189\0MINOR=129\0DEVNAME=bus/usb/002/002\0"
+            "DEVTYPE=usb_device\0PRODUCT=781/5581/100\0TYPE=0/0/0\0"
+            "BUSNUM=002\0DEVNUM=002\0SEQNUM=4705\0"),
+    UEVENT_MSG("change@/devices/LNXSYSTM:00/LNXSYBUS:00/PNP0C0A:00/"
+            "power_supply/BAT0\0"
+            "ACTION=change\0DEVPATH=/devices/LNXSYSTM:00/LNXSYBUS:00/"
+            "PNP0C0A:00/power_supply/BAT0\0"
+            "SUBSYSTEM=power_supply\0POWER_SUPPLY_NAME=BAT0\0"
+            "POWER_SUPPLY_TYPE=Battery\0POWER_SUPPLY_STATUS=Discharging\0"
+            "POWER_SUPPLY_PRESENT=1\0POWER_SUPPLY_TECHNOLOGY=Li-ion\0"
+            "POWER_SUPPLY_CYCLE_COUNT=0\0POWER_SUPPLY_VOLTAGE_NOW=11857000\0"
+            "POWER_SUPPLY_CURRENT_NOW=1120000\0"
+            "POWER_SUPPLY_CHARGE_FULL=4400000\0"
+            "POWER_SUPPLY_CHARGE_NOW=3100000\0POWER_SUPPLY_CAPACITY=70\0"
+            "POWER_SUPPLY_MODEL_NAME=DELL\0SEQNUM=5120\0"),
+    UEVENT_MSG("move@/devices/virtual/net/veth1\0"
+            "ACTION=move\0DEVPATH=/devices/virtual/net/veth1\0"
+            "SUBSYSTEM=net\0DEVPATH_OLD=/devices/virtual/net/veth0\0"
+            "INTERFACE=veth1\0IFINDEX=12\0SEQNUM=5121\0"),
+};
+
+#define CORPUS_SIZE (sizeof(corpus) / sizeof(corpus[0]))
+
+/* rounds timed at once */
+#define BENCH_CHUNK 1000
+
+/* splitter of udev_handle() before uevent_parse() */
+static key_value_t old_list = {.next = NULL, .key = NL_TYPE, .value = "UEVENT"};
+
+static key_value_t *old_set_next(key_value_t *kv, char *key, char *val)
+{
+    if (!kv)
+    {
+        kv = key_value_add(NULL, key, val);
+    }
+    else
+    {
+        if (!kv->next)
+            kv->next = key_value_add(NULL, key, val);
+
+        kv = kv->next;
+
+        kv->key = key;
+        kv->value = val;
+    }
+
+    return kv;
+}
+
+static int old_parse(char *uevent, int len, char **devpath, char **seqnum)
+{
+    unsigned int bufpos;
+    key_value_t *kv = &old_list;
+    char *key, *pos;
+    int i, keylen;
+
+    uevent[len] = '\0';
+    bufpos = strlen(uevent) + 1;
+
+    for (i = 0; (bufpos < (unsigned int)len); i++) {
+        key = &uevent[bufpos];
+        keylen = strlen(key);
+
+        pos = strchr(key, '=');
+
+        if (!pos)
+            break;
+
+        pos[0] = '\0';
+
+        kv = old_set_next(kv, key, &pos[1]);
+
+        if (!strcmp(key, "SEQNUM"))
+            *seqnum = &pos[1];
+        else if (!strcmp(key, "DEVPATH"))
+            *devpath = &pos[1];
+
+        bufpos += keylen + 1;
+    }
+
+    return i;
+}
+
+static double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    static uevent_t ev;
+    char buf[CORPUS_SIZE][1024];
+    char *devpath = NULL, *seqnum = NULL;
+    int rounds = argc > 1 ? atoi(argv[1]) : 1000000;
+    unsigned long vars_old = 0, vars_new = 0;
+    double start, time_old = 0, time_new = 0;
+    int i, j, k;
+
+    if (rounds <= 0)
+    {
+        fprintf(stderr, "usage: %s [ROUNDS]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    /*
+     * both parsers split in place, so the message is copied every time,
+     * they take turns to share the noise of the machine
+     */
+    for (i = 0; i < rounds; i += BENCH_CHUNK)
+    {
+        start = bench_now();
+        for (k = i; k < i + BENCH_CHUNK && k < rounds; k++)
+        {
+            for (j = 0; j < CORPUS_SIZE; j++)
+            {
+                memcpy(buf[j], corpus[j].msg, corpus[j].len);
+                vars_old += old_parse(buf[j], corpus[j].len, &devpath,
+                        &seqnum);
+            }
+        }
+        time_old += bench_now() - start;
+
+        start = bench_now();
+        for (k = i; k < i + BENCH_CHUNK && k < rounds; k++)
+        {
+            for (j = 0; j < CORPUS_SIZE; j++)
+            {
+                memcpy(buf[j], corpus[j].msg, corpus[j].len);
+                buf[j][corpus[j].len] = '\0';
+                vars_new += uevent_parse(&ev, buf[j], corpus[j].len);
+            }
+        }
+        time_new += bench_now() - start;
+    }
+
+    if (vars_old != vars_new)
+    {
+        fprintf(stderr, "parsers differ: %lu vs %lu variables\n",
+                vars_old, vars_new);
+        return EXIT_FAILURE;
+    }
+
+    printf("old parser: %.1f ns/event\n", time_old * 1e9 / rounds / CORPUS_SIZE);
+    printf("uevent_parse: %.1f ns/event\n",
+            time_new * 1e9 / rounds / CORPUS_SIZE);
+
+    key_value_free_all(old_list.next);
+
+    return 0;
+}
@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2013 Vadim Kochan <vadim4j@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Matching throughput of the worker pool: a stream of synthetic events is
+ * matched against many rules by the main thread (0 workers) and by 1, 2, 4
+ * and 8 workers. No rule matches the events, so no program is spawned and
+ * only the matching is measured.
+ *
+ * workers_bench [EVENTS] [RULES]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "defs.h"
+#include "event.h"
+#include "key_value.h"
+#include "utils.h"
+#include "log.h"
+
+#define BENCH_OBJECTS 1024
+
+static double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* each rule looks at one interface, the state never matches */
+static int bench_rules_make(char *dir, int rules)
+{
+    char path[256];
+    FILE *f;
+    int i;
+
+    if (!mkdtemp(dir))
+        return -1;
+
+    for (i = 0; i < rules; i++)
+    {
+        snprintf(path, sizeof(path), "%s/bench%d", dir, i);
+
+        if (!(f = fopen(path, "w")))
+            return -1;
+
+        fprintf(f, "NL_TYPE = BENCH\nEVENT = NEWADDR\nIF = ^bench%d$\n"
+                "ADDRESS = ^10\\.(0|%d)\\.[0-9]+\\.[0-9]+$\nSTATE = ^up$\n\n"
+                "exec /bin/true\n", i, i % 256);
+        fclose(f);
+    }
+
+    log_console = 0;
+    i = event_rules_load(dir);
+    log_console = 1;
+
+    return i;
+}
+
+static void bench_rules_remove(char *dir, int rules)
+{
+    char path[256];
+    int i;
+
+    for (i = 0; i < rules; i++)
+    {
+        snprintf(path, sizeof(path), "%s/bench%d", dir, i);
+        unlink(path);
+    }
+
+    rmdir(dir);
+}
+
+static double bench_run(int workers, int events)
+{
+    char ifname[16], address[32];
+    key_value_t vars[] =
+    {
+        { .key = NL_TYPE, .value = "BENCH" },
+        { .key = NL_EVENT, .value = "NEWADDR" },
+        { .key = NL_IF, .value = ifname },
+        { .key = NL_ADDRESS, .value = address },
+        { .key = NL_FAMILY, .value = "INET" },
+        { .key = NL_SCOPE, .value = "UNIVERSE" },
+        { .key = NL_PREFIXLEN, .value = "24" },
+        { .key = "STATE", .value = "down" },
+    };
+    double start, elapsed;
+    int i, obj;
+
+    for (i = 0; i < ARRAY_SIZE(vars) - 1; i++)
+        vars[i].next = &vars[i + 1];
+
+    event_workers = workers;
+
+    if (event_workers_init())
+        exit(EXIT_FAILURE);
+
+    start = bench_now();
+
+    for (i = 0; i < events; i++)
+    {
+        obj = i % BENCH_OBJECTS;
+        snprintf(ifname, sizeof(ifname), "bench%d", obj);
+        snprintf(address, sizeof(address), "10.%d.%d.1", obj % 256, i % 256);
+        event_nlmsg_send(vars, obj);
+    }
+
+    /* waits for the queued jobs */
+    event_workers_cleanup();
+    elapsed = bench_now() - start;
+
+    printf("%d workers: %d events in %.2f s, %.0f events/s\n", workers,
+            events, elapsed, events / elapsed);
+
+    return events / elapsed;
+}
+
+int main(int argc, char **argv)
+{
+    char dir[] = "/tmp/nleventd-bench-XXXXXX";
+    int events = argc > 1 ? atoi(argv[1]) : 5000;
+    int rules = argc > 2 ? atoi(argv[2]) : 200;
+    int workers[] = { 0, 1, 2, 4, 8 };
+    double base = 0, rate;
+    int i;
+
+    if (events <= 0 || rules <= 0)
+    {
+        fprintf(stderr, "usage: %s [EVENTS] [RULES]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (bench_rules_make(dir, rules))
+    {
+        fprintf(stderr, "Can't create the rules in %s\n", dir);
+        return EXIT_FAILURE;
+    }
+
+    /* per worker jobs and steals are logged by the pool */
+    log_console = 1;
+
+    printf("%d rules, %ld CPUs\n", rules, sysconf(_SC_NPROCESSORS_ONLN));
+
+    for (i = 0; i < ARRAY_SIZE(workers); i++)
+    {
+        rate = bench_run(workers[i], events);
+
+        if (workers[i] == 1)
+            base = rate;
+        else if (base)
+            printf("  %.2fx of 1 worker\n", rate / base);
+    }
+
+    event_rules_unload();
+    bench_rules_remove(dir, rules);
+
+    return 0;
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2013 Vadim Kochan <vadim4j@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "bpf.h"
+#include "log.h"
+
+void bpf_emit(bpf_prog_t *prog, unsigned short code, unsigned char jt,
+    unsigned char jf, unsigned int k)
+{
+    struct sock_filter insn = BPF_JUMP(code, k, jt, jf);
+
+    if (prog->len == prog->size)
+    {
+        prog->size = prog->size ? prog->size * 2 : 64;
+        prog->insns = (struct sock_filter *)realloc(prog->insns,
+                prog->size * sizeof(struct sock_filter));
+    }
+
+    prog->insns[prog->len++] = insn;
+}
+
+/*
+ * Continues with the next instruction after the emitted block if the packet
+ * contains str at offset, otherwise skips also the next skip instructions.
+ * mode is BPF_ABS or BPF_IND (offset is added to X). String is compared by
+ * the words, half-words and bytes which are loaded in network byte order.
+ */
+void bpf_emit_str_test(bpf_prog_t *prog, unsigned short mode,
+    unsigned int offset, char *str, int len, int skip)
+{
+    unsigned char *s = (unsigned char *)str;
+    int chunks = (len / 4) + ((len % 4) / 2) + (len % 2);
+    unsigned int val;
+    int size;
+
+    for (; len > 0; chunks--)
+    {
+        size = len >= 4 ? 4 : len >= 2 ? 2 : 1;
+
+        if (size == 4)
+        {
+            val = (s[0] << 24) | (s[1] << 16) | (s[2] << 8) | s[3];
+            bpf_emit(prog, BPF_LD | BPF_W | mode, 0, 0, offset);
+        }
+        else if (size == 2)
+        {
+            val = (s[0] << 8) | s[1];
+            bpf_emit(prog, BPF_LD | BPF_H | mode, 0, 0, offset);
+        }
+        else
+        {
+            val = s[0];
+            bpf_emit(prog, BPF_LD | BPF_B | mode, 0, 0, offset);
+        }
+
+        /* on mismatch skip the rest chunks and the next instructions */
+        bpf_emit(prog, BPF_JMP | BPF_JEQ | BPF_K, 0, (chunks - 1) * 2 + skip,
+                val);
+
+        s += size;
+        offset += size;
+        len -= size;
+    }
+}
+
+/*
+ * Returns ret if the packet contains str at offset, otherwise continues with
+ * the next instruction after the emitted block.
+ */
+void bpf_emit_str_match(bpf_prog_t *prog, unsigned int offset, char *str,
+    int len, unsigned int ret)
+{
+    bpf_emit_str_test(prog, BPF_ABS, offset, str, len, 1);
+    bpf_emit(prog, BPF_RET | BPF_K, 0, 0, ret);
+}
+
+int bpf_prog_attach(int sock, bpf_prog_t *prog)
+{
+    struct sock_fprog fprog =
+    {
+        .len = prog->len,
+        .filter = prog->insns,
+    };
+
+    if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)))
+    {
+        return nlevtd_log(LOG_ERR, "Can't attach socket filter: %s\n",
+                strerror(errno));
+    }
+
+    return 0;
+}
+
+int bpf_prog_detach(int sock)
+{
+    int dummy = 0;
+
+    if (setsockopt(sock, SOL_SOCKET, SO_DETACH_FILTER, &dummy, sizeof(dummy))
+            && errno != ENOENT)
+    {
+        return nlevtd_log(LOG_ERR, "Can't detach socket filter: %s\n",
+                strerror(errno));
+    }
+
+    return 0;
+}
+
+void bpf_prog_free(bpf_prog_t *prog)
+{
+    free(prog->insns);
+    prog->insns = NULL;
+    prog->len = prog->size = 0;
+}
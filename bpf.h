@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2013 Vadim Kochan <vadim4j@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BPF_H_
+#define _BPF_H_
+
+#include <linux/filter.h>
+
+#define BPF_ACCEPT 0xffffffff
+#define BPF_REJECT 0
+
+typedef struct bpf_prog
+{
+    struct sock_filter *insns;
+    int len;
+    int size;
+} bpf_prog_t;
+
+void bpf_emit(bpf_prog_t *prog, unsigned short code, unsigned char jt,
+    unsigned char jf, unsigned int k);
+void bpf_emit_str_test(bpf_prog_t *prog, unsigned short mode,
+    unsigned int offset, char *str, int len, int skip);
+void bpf_emit_str_match(bpf_prog_t *prog, unsigned int offset, char *str,
+    int len, unsigned int ret);
+int bpf_prog_attach(int sock, bpf_prog_t *prog);
+int bpf_prog_detach(int sock);
+void bpf_prog_free(bpf_prog_t *prog);
+
+#endif /* _BPF_H_ */
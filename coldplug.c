@@ -0,0 +1,356 @@
+/*
+ * Copyright (C) 2013 Vadim Kochan <vadim4j@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Walks the sysfs devices tree in the threads. The folders are taken from
+ * the shared stack, each folder is read once: the subfolders are pushed to
+ * the stack and the device (folder with uevent file and subsystem link) is
+ * handled if its subsystem is wanted.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include "coldplug.h"
+#include "log.h"
+
+/* DEVPATH is the path in sysfs */
+#define COLDPLUG_SYSFS "/sys"
+#define COLDPLUG_ROOT COLDPLUG_SYSFS "/devices"
+
+/* uevent file is one page at most */
+#define COLDPLUG_UEVENT_SIZE 4096
+
+typedef struct coldplug_dir
+{
+    struct coldplug_dir *next;
+    char path[];
+} coldplug_dir_t;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static pthread_t threads[COLDPLUG_THREADS_MAX];
+static int threads_count = 0;
+static coldplug_dir_t *dirs = NULL;
+static int dirs_busy = 0;
+static int stopping = 0;
+static coldplug_msg_t *msgs = NULL;
+static int msgs_count = 0;
+static int devices = 0;
+static int coldplug_mode;
+static coldplug_filter_t coldplug_filter;
+
+static coldplug_dir_t *coldplug_dir_alloc(char *parent, char *name)
+{
+    coldplug_dir_t *dir = (coldplug_dir_t *)malloc(sizeof(*dir) +
+            strlen(parent) + strlen(name) + 2);
+
+    sprintf(dir->path, name[0] ? "%s/%s" : "%s", parent, name);
+    return dir;
+}
+
+/* "add@DEVPATH\0ACTION=add\0DEVPATH=..\0SUBSYSTEM=..\0" + uevent file */
+static coldplug_msg_t *coldplug_msg_make(int dir_fd, char *devpath,
+    char *subsystem)
+{
+    char uevent[COLDPLUG_UEVENT_SIZE];
+    coldplug_msg_t *msg;
+    int fd, len, i;
+
+    if ((fd = openat(dir_fd, "uevent", O_RDONLY | O_CLOEXEC)) == -1)
+        return NULL;
+
+    len = read(fd, uevent, sizeof(uevent));
+    close(fd);
+
+    if (len < 0)
+        return NULL;
+
+    msg = (coldplug_msg_t *)malloc(sizeof(*msg) + 2 * strlen(devpath) +
+            strlen(subsystem) + len + 64);
+
+    msg->len = sprintf(msg->buf, COLDPLUG_ACTION "@%s", devpath) + 1;
+    msg->len += sprintf(msg->buf + msg->len, "ACTION=" COLDPLUG_ACTION) + 1;
+    msg->len += sprintf(msg->buf + msg->len, "DEVPATH=%s", devpath) + 1;
+    msg->len += sprintf(msg->buf + msg->len, "SUBSYSTEM=%s", subsystem) + 1;
+
+    /* KEY=VALUE lines */
+    for (i = 0; i < len; i++)
+        msg->buf[msg->len++] = uevent[i] == '\n' ? '\0' : uevent[i];
+
+    /* spare byte for the terminating NUL */
+    msg->buf[msg->len] = '\0';
+
+    return msg;
+}
+
+static void coldplug_device(int dir_fd, char *path)
+{
+    char link[PATH_MAX], *subsystem;
+    coldplug_msg_t *msg = NULL;
+    int len, fd;
+
+    if ((len = readlinkat(dir_fd, "subsystem", link, sizeof(link) - 1)) <= 0)
+        return;
+
+    link[len] = '\0';
+    subsystem = strrchr(link, '/') ? strrchr(link, '/') + 1 : link;
+
+    if (!coldplug_filter(subsystem))
+        return;
+
+    if (coldplug_mode == COLDPLUG_TRIGGER)
+    {
+        if ((fd = openat(dir_fd, "uevent", O_WRONLY | O_CLOEXEC)) == -1)
+            return;
+
+        len = write(fd, COLDPLUG_ACTION, strlen(COLDPLUG_ACTION));
+        close(fd);
+    }
+    else if (!(msg = coldplug_msg_make(dir_fd, path + strlen(COLDPLUG_SYSFS),
+                    subsystem)))
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&lock);
+
+    if (msg)
+    {
+        msg->next = msgs;
+        msgs = msg;
+        msgs_count++;
+    }
+
+    devices++;
+    pthread_mutex_unlock(&lock);
+}
+
+/* the subfolders are pushed to the stack at once */
+static void coldplug_dir_read(coldplug_dir_t *dir)
+{
+    coldplug_dir_t *subdirs = NULL, *last = NULL, *subdir;
+    struct dirent *dirent;
+    int is_device = 0;
+    DIR *d;
+
+    if (!(d = opendir(dir->path)))
+        return;
+
+    while ((dirent = readdir(d)))
+    {
+        if (dirent->d_type == DT_DIR && dirent->d_name[0] != '.')
+        {
+            subdir = coldplug_dir_alloc(dir->path, dirent->d_name);
+            subdir->next = subdirs;
+            subdirs = subdir;
+
+            if (!last)
+                last = subdir;
+        }
+        else if (dirent->d_type == DT_REG &&
+                !strcmp(dirent->d_name, "uevent"))
+        {
+            is_device = 1;
+        }
+    }
+
+    if (is_device)
+        coldplug_device(dirfd(d), dir->path);
+
+    closedir(d);
+
+    if (!subdirs)
+        return;
+
+    pthread_mutex_lock(&lock);
+    last->next = dirs;
+    dirs = subdirs;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&lock);
+}
+
+static void *coldplug_run(void *arg)
+{
+    coldplug_dir_t *dir;
+    sigset_t sigs;
+
+    /* signals are handled by the main thread */
+    sigfillset(&sigs);
+    pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+
+    pthread_mutex_lock(&lock);
+
+    for (;;)
+    {
+        /* the tree is walked when no folder is left and no one is read */
+        if (stopping || (!dirs && !dirs_busy))
+            break;
+
+        if (!dirs)
+        {
+            pthread_cond_wait(&cond, &lock);
+            continue;
+        }
+
+        dir = dirs;
+        dirs = dir->next;
+        dirs_busy++;
+
+        pthread_mutex_unlock(&lock);
+
+        coldplug_dir_read(dir);
+        free(dir);
+
+        pthread_mutex_lock(&lock);
+        dirs_busy--;
+    }
+
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+int coldplug_start(int mode, coldplug_filter_t filter)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int i, count;
+
+    if (threads_count)
+        coldplug_stop();
+
+    count = cpus < 1 ? 1 : cpus > COLDPLUG_THREADS_MAX ?
+        COLDPLUG_THREADS_MAX : cpus;
+
+    coldplug_mode = mode;
+    coldplug_filter = filter;
+    stopping = 0;
+    devices = 0;
+    dirs = coldplug_dir_alloc(COLDPLUG_ROOT, "");
+    dirs->next = NULL;
+
+    for (i = 0; i < count; i++)
+    {
+        if ((errno = pthread_create(&threads[i], NULL, coldplug_run, NULL)))
+        {
+            nlevtd_log(LOG_ERR, "Can't start coldplug thread: %s\n",
+                    strerror(errno));
+            break;
+        }
+
+        threads_count++;
+    }
+
+    if (!threads_count)
+    {
+        free(dirs);
+        dirs = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+static int coldplug_msg_cmp(const void *a, const void *b)
+{
+    return strcmp((*(coldplug_msg_t **)a)->buf, (*(coldplug_msg_t **)b)->buf);
+}
+
+static void coldplug_join(void)
+{
+    coldplug_dir_t *dir;
+    int i;
+
+    if (!threads_count)
+        return;
+
+    for (i = 0; i < threads_count; i++)
+        pthread_join(threads[i], NULL);
+
+    threads_count = 0;
+
+    /* left if the walk was stopped */
+    while ((dir = dirs))
+    {
+        dirs = dir->next;
+        free(dir);
+    }
+
+    nlevtd_log(LOG_DEBUG, "Coldplug: %d devices\n", devices);
+}
+
+/*
+ * Waits until the tree is walked, returns the messages sorted by DEVPATH,
+ * so the parent device comes before its children.
+ */
+coldplug_msg_t *coldplug_wait(void)
+{
+    coldplug_msg_t **sorted, *msg, *list = NULL;
+    int i;
+
+    coldplug_join();
+
+    if (!msgs_count)
+        return NULL;
+
+    sorted = (coldplug_msg_t **)malloc(msgs_count * sizeof(*sorted));
+
+    for (i = 0, msg = msgs; msg; msg = msg->next)
+        sorted[i++] = msg;
+
+    qsort(sorted, msgs_count, sizeof(*sorted), coldplug_msg_cmp);
+
+    for (i = msgs_count - 1; i >= 0; i--)
+    {
+        sorted[i]->next = list;
+        list = sorted[i];
+    }
+
+    free(sorted);
+    msgs = NULL;
+    msgs_count = 0;
+
+    return list;
+}
+
+void coldplug_stop(void)
+{
+    coldplug_msg_t *msg;
+
+    pthread_mutex_lock(&lock);
+    stopping = 1;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&lock);
+
+    coldplug_join();
+
+    while ((msg = msgs))
+    {
+        msgs = msg->next;
+        free(msg);
+    }
+
+    msgs_count = 0;
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2013 Vadim Kochan <vadim4j@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _COLDPLUG_H_
+#define _COLDPLUG_H_
+
+#define COLDPLUG_THREADS_MAX 8
+#define COLDPLUG_ACTION "add"
+
+enum
+{
+    COLDPLUG_NONE,
+    /* the uevent files are read, add uevents are made of them */
+    COLDPLUG_SCAN,
+    /* "add" is written to the uevent files, the kernel sends the uevents */
+    COLDPLUG_TRIGGER,
+};
+
+/* add uevent of the existing device in the kernel message form */
+typedef struct coldplug_msg
+{
+    struct coldplug_msg *next;
+    int len;
+    char buf[];
+} coldplug_msg_t;
+
+/* checks if the device of the subsystem is wanted */
+typedef int (*coldplug_filter_t)(char *subsystem);
+
+int coldplug_start(int mode, coldplug_filter_t filter);
+coldplug_msg_t *coldplug_wait(void);
+void coldplug_stop(void);
+
+#endif /* _COLDPLUG_H_ */
@@ -70,6 +70,25 @@
 #define NL_METRICS           "METRICS"
 #define NL_IIF               "IIF"
 #define NL_OIF               "OIF"
+#define NL_NETNS             "NETNS"
+#define NL_OPERSTATE         "OPERSTATE"
+#define NL_MASTER            "MASTER"
+#define NL_KIND              "KIND"
+#define NL_RX_PACKETS        "RX_PACKETS"
+#define NL_TX_PACKETS        "TX_PACKETS"
+#define NL_RX_BYTES          "RX_BYTES"
+#define NL_TX_BYTES          "TX_BYTES"
+#define NL_RX_ERRORS         "RX_ERRORS"
+#define NL_TX_ERRORS         "TX_ERRORS"
+#define NL_RX_DROPPED        "RX_DROPPED"
+#define NL_TX_DROPPED        "TX_DROPPED"
+#define NL_PREFERRED_LFT     "PREFERRED_LFT"
+#define NL_VALID_LFT         "VALID_LFT"
+#define NL_VLAN              "VLAN"
+#define NL_NEXTHOPS          "NEXTHOPS"
+#define NL_ADDED             "ADDED"
+#define NL_CHANGED           "CHANGED"
+#define NL_REMOVED           "REMOVED"
 #define NL_UNSPEC            "UNSPEC"
 
 #endif /* _DEFS_H_ */
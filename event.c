@@ -26,8 +26,15 @@
 #include <signal.h>
 #include <unistd.h>
 #include <regex.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <sys/pidfd.h>
 
+#include "defs.h"
 #include "event.h"
+#include "workers.h"
+#include "pollfd.h"
 #include "utils.h"
 #include "log.h"
 
@@ -36,10 +43,60 @@
         x++;
 
 #define NL_PARAM_SEP "= \t"
+#define ON_CHANGE_SEP ",= \t"
+#define ON_CHANGE_KEY "on_change"
+
+/* characters of the literal words of the patterns */
+#define WORD_CHARS "abcdefghijklmnopqrstuvwxyz" \
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-"
 
 int events_dump = 0;
+int event_workers = 0;
+
+/*
+ * Copy of the event with the rendered values, matched by a worker and its
+ * programs are run one by one.
+ */
+typedef struct event_job
+{
+    work_t work;
+    key_value_t *kv;
+} event_job_t;
+
+/* keys which select the kind of the event, checked before it is copied */
+static char *event_kind_keys[] = { NL_TYPE, NL_EVENT, "ACTION", "SUBSYSTEM" };
+
+/* compiled regex of the rule param, the pattern is kept for the handlers */
+typedef struct rule_param
+{
+    regex_t regex;
+    char pattern[];
+} rule_param_t;
+
+/* programs matched by an event, run one by one in the main thread */
+typedef struct event_run
+{
+    struct event_run *next;
+    char **envp;
+    char **execs;
+    int count;
+    int pos;
+} event_run_t;
 
 static rules_t *rules = NULL;
+static pthread_rwlock_t rules_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/* programs of the next events are dropped while so many runs wait */
+#define EVENT_RUNS_MAX 1024
+
+static event_run_t *runs_head = NULL;
+static event_run_t *runs_tail = NULL;
+static int runs_count = 0;
+static unsigned long runs_dropped = 0;
+/* running program, its pidfd if the kernel supports it */
+static pid_t run_pid = -1;
+static int run_pidfd = -1;
+static int run_sigchld = 0;
 
 static rules_t *rules_alloc(void)
 {
@@ -49,31 +106,33 @@ static rules_t *rules_alloc(void)
     return new_rule;
 }
 
-static void rules_free(rules_t *rules)
+/* Needs to do manualy free of nl_params because of regfree for value */
+static void nl_params_free(key_value_t *kv)
 {
-    /* Needs to do manualy free of n_params because of regfree for value */
-    if (rules->nl_params)
-    {
-        key_value_t *kv = rules->nl_params;
-        key_value_t *kv_next;
-
-        while (kv)
-        {
-            kv_next = kv->next;
+    key_value_t *kv_next;
 
-            if (kv->key)
-                free(kv->key);
+    while (kv)
+    {
+        kv_next = kv->next;
 
-            if (kv->value)
-            {
-                regfree(kv->value);
-                free(kv->value);
-            }
-            free(kv);
+        if (kv->key)
+            free(kv->key);
 
-            kv = kv_next;
+        if (kv->value)
+        {
+            regfree(&((rule_param_t *)kv->value)->regex);
+            free(kv->value);
         }
+        free(kv);
+
+        kv = kv_next;
     }
+}
+
+static void rules_free(rules_t *rules)
+{
+    nl_params_free(rules->nl_params);
+    key_value_free_full(rules->on_change);
 
     if (rules->exec)
         free(rules->exec);
@@ -83,16 +142,36 @@ static void rules_free(rules_t *rules)
 
 void event_rules_unload()
 {
-    rules_t *rule_next;
+    rules_t *rule_next, *rule;
+
+    pthread_rwlock_wrlock(&rules_lock);
+    rule = rules;
+    rules = NULL;
+    pthread_rwlock_unlock(&rules_lock);
 
-    while (rules)
+    while (rule)
     {
-        rule_next = rules->next;
-        rules_free(rules);
-        rules = rule_next;
+        rule_next = rule->next;
+        rules_free(rule);
+        rule = rule_next;
     }
 }
 
+/* keeps OLD_* names of the fields, the event has them if they were changed */
+static key_value_t *on_change_parse(key_value_t *on_change)
+{
+    char *name, *old_name;
+
+    while ((name = strtok(NULL, ON_CHANGE_SEP)))
+    {
+        old_name = (char *)malloc(strlen("OLD_") + strlen(name) + 1);
+        sprintf(old_name, "OLD_%s", name);
+        on_change = key_value_add(on_change, old_name, NULL);
+    }
+
+    return on_change;
+}
+
 static rules_t *parse_file(int fd)
 {
     char buf[1024];
@@ -100,7 +179,8 @@ static rules_t *parse_file(int fd)
     FILE *f = fdopen(fd, "re");
     rules_t *rule = NULL;
     key_value_t *kv = NULL;
-    regex_t *regex;
+    key_value_t *on_change = NULL;
+    rule_param_t *param = NULL;
     int line = 0;
     char *exec = NULL;
 
@@ -146,23 +226,38 @@ static rules_t *parse_file(int fd)
         }
         else
         {
-            key = str_clone(strtok(p, NL_PARAM_SEP));
+            key = strtok(p, NL_PARAM_SEP);
+
+            /* "on_change = FIELD,..." is not matched as regex */
+            if (key && !strcasecmp(key, ON_CHANGE_KEY))
+            {
+                on_change = on_change_parse(on_change);
+                continue;
+            }
+
+            key = str_clone(key);
             val = strtok(NULL, NL_PARAM_SEP);
-            regex = (regex_t *)malloc(sizeof(*regex));
+            param = (rule_param_t *)malloc(sizeof(*param) +
+                    (val ? strlen(val) + 1 : 1));
+            strcpy(param->pattern, val ? val : "");
 
-            if (regcomp(regex, val, REG_EXTENDED))
+            if (regcomp(&param->regex, param->pattern, REG_EXTENDED))
             {
-                key_value_free_full(kv);
                 nlevtd_log(LOG_ERR, "Can't compile regex [%s], line %d\n",
                     val, line);
 
                 if (key)
                     free(key);
 
+                /* not compiled, only the memory is freed */
+                free(param);
+                param = NULL;
+
                 goto Error;
             }
 
-            kv = key_value_add(kv, key, regex);
+            kv = key_value_add(kv, key, param);
+            param = NULL;
         }
     }
 
@@ -176,6 +271,7 @@ static rules_t *parse_file(int fd)
     rule = rules_alloc();
     rule->exec = exec;
     rule->nl_params = kv;
+    rule->on_change = on_change;
 
     fclose(f);
     return rule;
@@ -184,11 +280,8 @@ Error:
     if (exec)
         free(exec);
 
-    if (regex)
-    {
-        regfree(regex);
-        free(regex);
-    }
+    nl_params_free(kv);
+    key_value_free_full(on_change);
 
     fclose(f);
     return NULL;
@@ -241,75 +334,658 @@ int event_rules_load(char *rules_dir)
         }
 
         close(fd);
-        rules = rules_list;
     }
 
+    pthread_rwlock_wrlock(&rules_lock);
+    rules = rules_list;
+    pthread_rwlock_unlock(&rules_lock);
+
     closedir(dir);
     return 0;
 }
 
-void event_nlmsg_send(key_value_t *kv)
+static int event_rule_may_match(rules_t *r, key_value_t *tmpl, int open)
+{
+    key_value_t *kv_r, *kv_t;
+    int may_match = 1;
+
+    for (kv_r = r->nl_params; kv_r && may_match; kv_r = kv_r->next)
+    {
+        for (kv_t = tmpl; kv_t; kv_t = kv_t->next)
+        {
+            if (!strcasecmp((char *)kv_r->key, (char *)kv_t->key))
+                break;
+        }
+
+        if (!kv_t)
+            may_match = open;
+        else if (kv_t->value)
+            may_match = !regexec(&((rule_param_t *)kv_r->value)->regex,
+                    (char *)kv_t->value, 0, NULL, 0);
+    }
+
+    return may_match;
+}
+
+/*
+ * Checks if any loaded rule could match an event described by the template.
+ * Template contains the keys of the event, NULL value means that the value
+ * is not known in advance. Open template means that the event may have
+ * other keys too.
+ */
+int event_rules_may_match(key_value_t *tmpl, int open)
 {
     rules_t *r;
-    key_value_t *kv_rule, *kv_r, *kv_nl;
-    int kv_r_count, matches;
-    struct stat f_stat;
-    pid_t pid;
-    int status, key_match;
+    int may_match = 0;
 
-    if (events_dump)
-        key_value_dump(kv);
+    pthread_rwlock_rdlock(&rules_lock);
 
-    for (r = rules; r; r = r->next)
+    for (r = rules; r && !may_match; r = r->next)
+        may_match = event_rule_may_match(r, tmpl, open);
+
+    pthread_rwlock_unlock(&rules_lock);
+
+    return may_match;
+}
+
+/* checks if any rule which could match the event looks at the key */
+int event_rules_use_key(key_value_t *tmpl, char *key)
+{
+    key_value_t *kv_r;
+    rules_t *r;
+    int used = 0;
+
+    pthread_rwlock_rdlock(&rules_lock);
+
+    for (r = rules; r && !used; r = r->next)
     {
-        kv_r_count = matches = 0;
+        if (!event_rule_may_match(r, tmpl, 0))
+            continue;
+
+        for (kv_r = r->nl_params; kv_r && !used; kv_r = kv_r->next)
+            used = !strcasecmp((char *)kv_r->key, key);
+    }
+
+    pthread_rwlock_unlock(&rules_lock);
+
+    return used;
+}
 
-        for (kv_r = r->nl_params; kv_r; kv_r = kv_r->next, kv_r_count++)
+/*
+ * Calls func with each literal word (letters, digits, '_' and '-') of the key
+ * patterns, e.g. the handler may take them as the values to check.
+ */
+void event_rules_words(char *key, void (*func)(char *word, void *arg),
+    void *arg)
+{
+    key_value_t *kv_r;
+    rules_t *r;
+    char word[64];
+    char *p;
+    int len;
+
+    pthread_rwlock_rdlock(&rules_lock);
+
+    for (r = rules; r; r = r->next)
+    {
+        for (kv_r = r->nl_params; kv_r; kv_r = kv_r->next)
         {
-            for (kv_nl = kv; kv_nl; kv_nl = kv_nl->next)
+            if (strcasecmp((char *)kv_r->key, key))
+                continue;
+
+            for (p = ((rule_param_t *)kv_r->value)->pattern; *p; p += len)
             {
-                if (!kv_nl->value)
-                    continue;
+                len = strspn(p, WORD_CHARS);
 
-                key_match = !strcasecmp((char *)kv_r->key, (char *)kv_nl->key);
+                if (!len)
+                {
+                    len = 1;
+                    continue;
+                }
 
-                if (key_match && !regexec((regex_t *)kv_r->value,
-                            (char *)kv_nl->value, 0, NULL, 0))
+                if (len < sizeof(word))
                 {
-                    matches++;
+                    memcpy(word, p, len);
+                    word[len] = '\0';
+                    func(word, arg);
                 }
             }
         }
+    }
+
+    pthread_rwlock_unlock(&rules_lock);
+}
+
+/* pattern matches only its words, "^word$" or "^(word|word)$" */
+static int event_pattern_is_literal(char *p)
+{
+    int i, len = strlen(p);
+
+    if (len < 3 || p[0] != '^' || p[len - 1] != '$')
+        return 0;
+
+    p++;
+    len -= 2;
 
-        if (kv_r_count == matches)
+    if (p[0] == '(')
+    {
+        if (len < 3 || p[len - 1] != ')')
+            return 0;
+
+        p++;
+        len -= 2;
+
+        for (i = 0; i < len; i++)
         {
-            if (stat(r->exec, &f_stat))
-            {
-                nlevtd_log(LOG_ERR, "Can't exec %s: %s\n", r->exec, strerror(errno));
+            if (p[i] == '|' && i > 0 && i < len - 1 && p[i - 1] != '|')
                 continue;
-            }
 
-            if ((pid = fork()) == -1)
+            if (!strchr(WORD_CHARS, p[i]))
+                return 0;
+        }
+
+        return 1;
+    }
+
+    return strspn(p, WORD_CHARS) == len;
+}
+
+/*
+ * Checks that each pattern of the key matches only its literal words, so the
+ * words passed by event_rules_words are all the values the rules may match.
+ */
+int event_rules_literal(char *key)
+{
+    key_value_t *kv_r;
+    rules_t *r;
+    int literal = 1;
+
+    pthread_rwlock_rdlock(&rules_lock);
+
+    for (r = rules; r && literal; r = r->next)
+    {
+        for (kv_r = r->nl_params; kv_r && literal; kv_r = kv_r->next)
+        {
+            if (!strcasecmp((char *)kv_r->key, key))
             {
-                nlevtd_log(LOG_ERR, "fork(): %s\n", strerror(errno));
-                continue;
+                literal = event_pattern_is_literal(
+                        ((rule_param_t *)kv_r->value)->pattern);
             }
-            else if (pid == 0)
-            {
-                signal(SIGHUP, SIG_DFL);
-                signal(SIGTERM, SIG_DFL);
-                signal(SIGINT, SIG_DFL);
+        }
+    }
+
+    pthread_rwlock_unlock(&rules_lock);
+
+    return literal;
+}
 
-                umask(0077);
+/* calls func with each param key of the rules which starts with prefix */
+void event_rules_keys(char *prefix, void (*func)(char *key, void *arg),
+    void *arg)
+{
+    key_value_t *kv_r;
+    rules_t *r;
 
-                execle("/bin/sh", "/bin/sh", "-c", r->exec, NULL,
-                        key_value_to_env(kv));
+    pthread_rwlock_rdlock(&rules_lock);
 
-                nlevtd_log(LOG_ERR, "execl(): %s\n", strerror(errno));
-                _exit(EXIT_FAILURE);
+    for (r = rules; r; r = r->next)
+    {
+        for (kv_r = r->nl_params; kv_r; kv_r = kv_r->next)
+        {
+            if (!strncasecmp((char *)kv_r->key, prefix, strlen(prefix)))
+                func((char *)kv_r->key, arg);
+        }
+    }
+
+    pthread_rwlock_unlock(&rules_lock);
+}
+
+/*
+ * Event of the object with known previous state has OLD_* variables, the
+ * value is not rendered if the field was not changed. Other events (new
+ * objects, DEL*, DUMP*) are not filtered.
+ */
+static int event_rule_changed(rules_t *r, key_value_t *kv)
+{
+    key_value_t *kv_c, *kv_nl;
+    int known = 0;
+
+    for (kv_c = r->on_change; kv_c; kv_c = kv_c->next)
+    {
+        for (kv_nl = kv; kv_nl; kv_nl = kv_nl->next)
+        {
+            if (strcasecmp((char *)kv_c->key, (char *)kv_nl->key))
+                continue;
+
+            if (key_value_get(kv_nl))
+                return 1;
+
+            known = 1;
+        }
+    }
+
+    return !known;
+}
+
+static int event_rule_match(rules_t *r, key_value_t *kv)
+{
+    key_value_t *kv_r, *kv_nl;
+    int kv_r_count = 0, matches = 0;
+
+    if (r->on_change && !event_rule_changed(r, kv))
+        return 0;
+
+    for (kv_r = r->nl_params; kv_r; kv_r = kv_r->next, kv_r_count++)
+    {
+        for (kv_nl = kv; kv_nl; kv_nl = kv_nl->next)
+        {
+            if (strcasecmp((char *)kv_r->key, (char *)kv_nl->key))
+                continue;
+
+            /* only the values the rules look at are rendered */
+            if (key_value_get(kv_nl) &&
+                    !regexec(&((rule_param_t *)kv_r->value)->regex,
+                        (char *)kv_nl->value, 0, NULL, 0))
+            {
+                matches++;
             }
+        }
+    }
+
+    return kv_r_count == matches;
+}
 
-            waitpid(pid, &status, 0);
+static pid_t event_spawn(char *exec, char **envp)
+{
+    struct stat f_stat;
+    sigset_t sigs;
+    pid_t pid;
+
+    if (stat(exec, &f_stat))
+    {
+        nlevtd_log(LOG_ERR, "Can't exec %s: %s\n", exec, strerror(errno));
+        return -1;
+    }
+
+    if ((pid = fork()) == -1)
+    {
+        nlevtd_log(LOG_ERR, "fork(): %s\n", strerror(errno));
+        return -1;
+    }
+    else if (pid == 0)
+    {
+        signal(SIGHUP, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGINT, SIG_DFL);
+
+        /* worker threads block all the signals */
+        sigemptyset(&sigs);
+        sigprocmask(SIG_SETMASK, &sigs, NULL);
+
+        umask(0077);
+
+        execle("/bin/sh", "/bin/sh", "-c", exec, NULL, envp);
+
+        nlevtd_log(LOG_ERR, "execl(): %s\n", strerror(errno));
+        _exit(EXIT_FAILURE);
+    }
+
+    return pid;
+}
+
+static void event_exec(char *exec, char **envp)
+{
+    pid_t pid;
+    int status;
+
+    if ((pid = event_spawn(exec, envp)) > 0)
+        waitpid(pid, &status, 0);
+}
+
+static int event_match(key_value_t *kv, char ***execs)
+{
+    int count = 0;
+    rules_t *r;
+
+    *execs = NULL;
+
+    /* rules may be reloaded by the main thread while the workers match */
+    pthread_rwlock_rdlock(&rules_lock);
+
+    for (r = rules; r; r = r->next)
+    {
+        if (!event_rule_match(r, kv))
+            continue;
+
+        *execs = (char **)realloc(*execs, sizeof(char *) * (count + 1));
+        (*execs)[count++] = str_clone(r->exec);
+    }
+
+    pthread_rwlock_unlock(&rules_lock);
+
+    return count;
+}
+
+static void event_run_free(event_run_t *run)
+{
+    int i;
+
+    for (i = 0; i < run->count; i++)
+        free(run->execs[i]);
+
+    key_value_env_free(run->envp);
+    free(run->execs);
+    free(run);
+}
+
+static void event_run_next(void);
+
+/* removes the first run, its programs which are not started yet are skipped */
+static void event_run_drop(void)
+{
+    event_run_t *run = runs_head;
+
+    if (!run)
+        return;
+
+    if (!(runs_head = run->next))
+        runs_tail = NULL;
+
+    runs_count--;
+    event_run_free(run);
+}
+
+static void on_child_exit(int fd, void *arg)
+{
+    siginfo_t info;
+    int err = 0;
+
+    memset(&info, 0, sizeof(info));
+
+    if (waitid(P_PIDFD, fd, &info, WEXITED | WNOHANG))
+        err = errno;
+    else if (!info.si_pid)
+        return;
+
+    /* the pidfd stays readable, the run can't be followed any more */
+    poll_unregister_handler(fd);
+    close(fd);
+    run_pidfd = -1;
+    run_pid = -1;
+
+    if (err)
+    {
+        nlevtd_log(LOG_ERR, "Can't wait for the program: %s\n",
+                strerror(err));
+        event_run_drop();
+    }
+
+    event_run_next();
+}
+
+static void on_sigchld(int signo, void *arg)
+{
+    int status;
+
+    /* only the own child is reaped, the workers wait for theirs */
+    if (run_pid < 0 || run_pidfd >= 0 ||
+            waitpid(run_pid, &status, WNOHANG) != run_pid)
+    {
+        return;
+    }
+
+    run_pid = -1;
+    event_run_next();
+}
+
+/*
+ * Waits for the exit of the started program via pidfd or SIGCHLD, so the main
+ * loop keeps handling the events meanwhile. Returns 1 if the program has
+ * already exited.
+ */
+static int event_run_wait(pid_t pid)
+{
+    int status;
+
+    run_pid = pid;
+
+    if ((run_pidfd = pidfd_open(pid, 0)) >= 0)
+    {
+        if (!poll_register_handler_flags(run_pidfd, 0, on_child_exit, NULL))
+            return 0;
+
+        close(run_pidfd);
+        run_pidfd = -1;
+    }
+
+    /* the signal is blocked first, so the exit can't be missed below */
+    if (!run_sigchld && !poll_register_signal(SIGCHLD, on_sigchld, NULL))
+        run_sigchld = 1;
+
+    if (run_sigchld && !waitpid(pid, &status, WNOHANG))
+        return 0;
+
+    if (!run_sigchld)
+        waitpid(pid, &status, 0);
+
+    run_pid = -1;
+    return 1;
+}
+
+/* starts the next queued program, the runs are freed once all are done */
+static void event_run_next(void)
+{
+    event_run_t *run;
+    pid_t pid;
+
+    while ((run = runs_head))
+    {
+        if (run->pos == run->count)
+        {
+            event_run_drop();
+            continue;
         }
+
+        if ((pid = event_spawn(run->execs[run->pos++], run->envp)) < 0)
+            continue;
+
+        if (!event_run_wait(pid))
+            return;
     }
 }
+
+static void event_runs_dropped_log(void)
+{
+    if (!runs_dropped)
+        return;
+
+    nlevtd_log(LOG_WARNING, "Programs of %lu events were not run\n",
+            runs_dropped);
+    runs_dropped = 0;
+}
+
+/* the programs of the events are run in order of the events */
+static void event_run_queue(key_value_t *kv)
+{
+    event_run_t *run;
+    char **execs;
+    int count;
+
+    if (!(count = event_match(kv, &execs)))
+        return;
+
+    /* the programs are slower than the events, they are not queued forever */
+    if (runs_count >= EVENT_RUNS_MAX)
+    {
+        if (!runs_dropped++)
+        {
+            nlevtd_log(LOG_WARNING, "%d events wait for their programs, "
+                    "the programs of the next ones are not run\n", runs_count);
+        }
+
+        while (count)
+            free(execs[--count]);
+
+        free(execs);
+        return;
+    }
+
+    event_runs_dropped_log();
+
+    run = (event_run_t *)malloc(sizeof(event_run_t));
+    run->next = NULL;
+    run->envp = key_value_to_env(kv);
+    run->execs = execs;
+    run->count = count;
+    run->pos = 0;
+
+    if (runs_tail)
+        runs_tail->next = run;
+    else
+        runs_head = run;
+
+    runs_tail = run;
+    runs_count++;
+
+    if (run_pid < 0)
+        event_run_next();
+}
+
+/* waits for the running program, the queued ones are not run */
+void event_runs_cleanup(void)
+{
+    event_run_t *next;
+    int status;
+
+    if (run_pid > 0)
+        waitpid(run_pid, &status, 0);
+
+    if (run_pidfd >= 0)
+        close(run_pidfd);
+
+    run_pid = run_pidfd = -1;
+
+    while (runs_head)
+    {
+        next = runs_head->next;
+        event_run_free(runs_head);
+        runs_head = next;
+    }
+
+    runs_tail = NULL;
+    runs_count = 0;
+
+    event_runs_dropped_log();
+}
+
+static void event_job_run(work_t *work)
+{
+    event_job_t *job = (event_job_t *)work;
+    char **execs, **envp;
+    int i, count;
+
+    if ((count = event_match(job->kv, &execs)))
+    {
+        envp = key_value_to_env(job->kv);
+
+        for (i = 0; i < count; i++)
+        {
+            event_exec(execs[i], envp);
+            free(execs[i]);
+        }
+
+        key_value_env_free(envp);
+        free(execs);
+    }
+
+    key_value_free_full(job->kv);
+    free(job);
+}
+
+int event_workers_init(void)
+{
+    if (!event_workers)
+        return 0;
+
+    return workers_init(event_workers, event_job_run);
+}
+
+void event_workers_cleanup(void)
+{
+    workers_cleanup();
+}
+
+/*
+ * Checks the keys of the event kind which are known without rendering, the
+ * other keys are matched by the workers.
+ */
+static int event_kind_may_match(key_value_t *kv)
+{
+    key_value_t tmpl[ARRAY_SIZE(event_kind_keys)];
+    key_value_t *kv_t = NULL;
+    int i, count = 0;
+
+    for (; kv; kv = kv->next)
+    {
+        if (kv->render)
+            continue;
+
+        for (i = 0; i < ARRAY_SIZE(event_kind_keys); i++)
+        {
+            if (count < ARRAY_SIZE(tmpl) &&
+                    !strcmp((char *)kv->key, event_kind_keys[i]))
+            {
+                tmpl[count] = (key_value_t){ .next = kv_t, .key = kv->key,
+                    .value = kv->value };
+                kv_t = &tmpl[count++];
+            }
+        }
+    }
+
+    return event_rules_may_match(kv_t, 1);
+}
+
+/* the values are rendered, so the copy doesn't depend on the handler */
+static key_value_t *event_copy(key_value_t *kv)
+{
+    key_value_t *copy = NULL, **tail = &copy;
+    char *value;
+
+    for (; kv; kv = kv->next)
+    {
+        value = key_value_get(kv);
+
+        *tail = key_value_add(NULL, str_clone(kv->key),
+                value ? str_clone(value) : NULL);
+        tail = &(*tail)->next;
+    }
+
+    return copy;
+}
+
+/*
+ * Matches the event and runs the programs, obj_hash identifies the kernel
+ * object, the events of the same object are handled in order.
+ */
+void event_nlmsg_send(key_value_t *kv, unsigned int obj_hash)
+{
+    event_job_t *job;
+
+    if (events_dump)
+        key_value_dump(kv);
+
+    if (!event_workers)
+    {
+        event_run_queue(kv);
+        return;
+    }
+
+    /* the events of the kinds no rule looks at are not copied at all */
+    if (!event_kind_may_match(kv))
+        return;
+
+    job = (event_job_t *)malloc(sizeof(event_job_t));
+    job->kv = event_copy(kv);
+
+    workers_queue(obj_hash, &job->work);
+}
@@ -21,16 +21,29 @@
 #include "key_value.h"
 
 extern int events_dump;
+extern int event_workers;
 
 typedef struct rules
 {
     key_value_t *nl_params;
+    /* OLD_* names of the fields, one of them should be changed */
+    key_value_t *on_change;
     char *exec;
     struct rules *next;
 } rules_t;
 
 int event_rules_load(char *rules_dir);
 void event_rules_unload();
-void event_nlmsg_send(key_value_t *kv);
+void event_nlmsg_send(key_value_t *kv, unsigned int obj_hash);
+int event_workers_init(void);
+void event_workers_cleanup(void);
+void event_runs_cleanup(void);
+int event_rules_may_match(key_value_t *tmpl, int open);
+int event_rules_use_key(key_value_t *tmpl, char *key);
+void event_rules_words(char *key, void (*func)(char *word, void *arg),
+    void *arg);
+int event_rules_literal(char *key);
+void event_rules_keys(char *prefix, void (*func)(char *key, void *arg),
+    void *arg);
 
 #endif /* _EVENT_H_ */
@@ -16,6 +16,8 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <errno.h>
 #include <sys/inotify.h>
 
@@ -37,10 +39,30 @@ typedef struct fsnotify_handler
     int flags;
     void *arg;
     void (* func)(struct inotify_event *e, void *arg);
+    /* unregistered while the events are dispatched */
+    int removed;
     struct fsnotify_handler *next;
 } fsnotify_handler_t;
 
 static fsnotify_handler_t *handlers = NULL;
+static int dispatching = 0;
+
+static void fsnotify_handlers_purge(void)
+{
+    fsnotify_handler_t **ph, *h;
+
+    for (ph = &handlers; (h = *ph); )
+    {
+        if (!h->removed)
+        {
+            ph = &h->next;
+            continue;
+        }
+
+        *ph = h->next;
+        free(h);
+    }
+}
 
 static void on_fsnotify_poll(int fd, void *arg)
 {
@@ -56,6 +78,9 @@ static void on_fsnotify_poll(int fd, void *arg)
         return;
     }
 
+    /* the handlers may register and unregister the watches */
+    dispatching = 1;
+
     while (i < len)
     {
         fsnotify_handler_t *h = handlers;
@@ -63,7 +88,7 @@ static void on_fsnotify_poll(int fd, void *arg)
 
 	while (h)
         {
-            if (h->wd == event->wd)
+            if (h->wd == event->wd && !h->removed)
                 h->func(event, h->arg);
 
 	    h = h->next;
@@ -71,31 +96,43 @@ static void on_fsnotify_poll(int fd, void *arg)
 
         i += EVENT_SIZE + event->len;
     }
+
+    dispatching = 0;
+    fsnotify_handlers_purge();
+}
+
+static int fsnotify_watch_add(fsnotify_handler_t *h)
+{
+    h->fd = notify_fd;
+    h->flags = h->flags ? h->flags : DEFAULT_FLAGS;
+
+    h->wd = inotify_add_watch(notify_fd, h->path, h->flags);
+    if (h->wd < 0)
+    {
+        return nlevtd_log(LOG_ERR, "Can't add watch for %s: %s\n", h->path,
+                strerror(errno));
+    }
+
+    return 0;
 }
 
 int fsnotify_init(void)
 {
     fsnotify_handler_t *h = handlers;
 
-    notify_fd = inotify_init();
+    notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
 
     while (h)
     {
-        h->fd = notify_fd;
-        h->flags = h->flags ? h->flags : DEFAULT_FLAGS;
-
-        h->wd = inotify_add_watch(notify_fd, h->path, h->flags);
-	if (h->wd < 0)
-        {
-            nlevtd_log(LOG_ERR, "Can't add watch for %s\n", h->path);
+        if (fsnotify_watch_add(h))
             return -1;
-        }
-
-	poll_register_handler(h->fd, on_fsnotify_poll, NULL);
 
         h = h->next;
     }
 
+    /* all the watches share the same inotify fd */
+    poll_register_handler(notify_fd, on_fsnotify_poll, NULL);
+
     return 0;
 }
 
@@ -106,25 +143,75 @@ void fsnotify_cleanup(void)
     while (handlers)
     {
         next = handlers->next;
-        inotify_rm_watch(handlers->fd, handlers->wd);
+
+        if (!handlers->removed)
+            inotify_rm_watch(handlers->fd, handlers->wd);
+
         free(handlers);
         handlers = next;
     }
 
     if (notify_fd != -1)
         close(notify_fd);
+
+    notify_fd = -1;
 }
 
+/* the watch is added at once if fsnotify_init was already called */
 int fsnotify_register_handler(char *path, int flags,
     void (* func)(struct inotify_event *e, void *arg), void *arg)
 {
     fsnotify_handler_t *new = (fsnotify_handler_t *)malloc(sizeof(fsnotify_handler_t));
+    memset(new, 0, sizeof(fsnotify_handler_t));
     new->path = path;
     new->flags = flags;
     new->arg = arg;
     new->func = func;
+
+    if (notify_fd != -1 && fsnotify_watch_add(new))
+    {
+        free(new);
+        return -1;
+    }
+
     new->next = handlers;
     handlers = new;
 
     return 0;
 }
+
+/* may be called from the handlers, the own one too */
+void fsnotify_unregister_handler(char *path,
+    void (* func)(struct inotify_event *e, void *arg))
+{
+    fsnotify_handler_t *h;
+
+    for (h = handlers; h; h = h->next)
+    {
+        if (!h->removed && h->func == func && !strcmp(h->path, path))
+            break;
+    }
+
+    if (!h)
+        return;
+
+    /* the watch descriptor is shared by the watches of the same path */
+    if (notify_fd != -1 && h->wd >= 0)
+    {
+        fsnotify_handler_t *it;
+
+        for (it = handlers; it; it = it->next)
+        {
+            if (it != h && !it->removed && it->wd == h->wd)
+                break;
+        }
+
+        if (!it)
+            inotify_rm_watch(notify_fd, h->wd);
+    }
+
+    h->removed = 1;
+
+    if (!dispatching)
+        fsnotify_handlers_purge();
+}
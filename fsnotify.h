@@ -24,5 +24,7 @@ int fsnotify_init(void);
 void fsnotify_cleanup(void);
 int fsnotify_register_handler(char *path, int flags,
     void (* func)(struct inotify_event *e, void *arg), void *arg);
+void fsnotify_unregister_handler(char *path,
+    void (* func)(struct inotify_event *e, void *arg));
 
 #endif /* _FSNOTIFY_H_ */
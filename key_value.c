@@ -18,8 +18,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <ctype.h>
 
 #include "key_value.h"
+#include "utils.h"
 #include "log.h"
 
 key_value_t *key_value_alloc(void)
@@ -74,7 +76,7 @@ int key_value_non_empty_count(key_value_t *kv)
 
     for (; kv; kv = kv->next)
     {
-        if (!str_is_empty((char *)kv->value))
+        if (!str_is_empty(key_value_get(kv)))
             c++;
     }
 
@@ -85,7 +87,7 @@ void key_value_dump(key_value_t *kv)
 {
     for (; kv; kv = kv->next)
     {
-        if (str_is_empty((char *)kv->value))
+        if (str_is_empty(key_value_get(kv)))
             continue;
 
         nlevtd_log(LOG_DEBUG, "%s=%s\n", (char *)kv->key, (char *)kv->value);
@@ -94,19 +96,48 @@ void key_value_dump(key_value_t *kv)
     nlevtd_log(LOG_DEBUG, "----------------------------------------\n");
 }
 
+/*
+ * Copies the key as the shell variable name, the other characters are
+ * replaced by '_' (e.g. ATTR{../size} is ATTR_size).
+ */
+static char *key_value_env_name(char *env, char *key)
+{
+    int skip = 0;
+
+    for (; *key; key++)
+    {
+        if (isalnum((unsigned char)*key) || *key == '_')
+        {
+            if (skip)
+                *env++ = '_';
+
+            *env++ = *key;
+            skip = 0;
+        }
+        else
+        {
+            skip = 1;
+        }
+    }
+
+    return env;
+}
+
 char **key_value_to_env(key_value_t *kv)
 {
     int i;
+    char *pos;
     char **envp = (char **)malloc(sizeof(char *) *
-            key_value_non_empty_count(kv) + 1);
+            (key_value_non_empty_count(kv) + 1));
 
     for (i = 0; kv; kv = kv->next)
     {
-        if (str_is_empty((char *)kv->value))
+        if (str_is_empty(key_value_get(kv)))
             continue;
 
         envp[i] = (char *)malloc(strlen(kv->key) + strlen(kv->value) + 2);
-        sprintf(envp[i], "%s=%s", (char *)kv->key, (char *)kv->value);
+        pos = key_value_env_name(envp[i], kv->key);
+        sprintf(pos, "=%s", (char *)kv->value);
         i++;
     }
 
@@ -114,6 +145,27 @@ char **key_value_to_env(key_value_t *kv)
     return envp;
 }
 
+void key_value_env_free(char **envp)
+{
+    char **env;
+
+    for (env = envp; *env; env++)
+        free(*env);
+
+    free(envp);
+}
+
+char *key_value_get(key_value_t *kv)
+{
+    if (kv->render)
+    {
+        kv->value = kv->render(kv);
+        kv->render = NULL;
+    }
+
+    return kv->value;
+}
+
 int key_value_set(key_value_t *kv, char *key, char *value)
 {
     for (; kv; kv = kv->next)
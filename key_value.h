@@ -23,6 +23,8 @@ typedef struct key_value
     struct key_value *next;
     void *key;
     void *value;
+    /* renders the value on the first use, the result is kept in value */
+    char *(*render)(struct key_value *kv);
 } key_value_t;
 
 key_value_t *key_value_alloc(void);
@@ -32,6 +34,8 @@ void key_value_free_full(key_value_t *kv);
 int key_value_non_empty_count(key_value_t *kv);
 void key_value_dump(key_value_t *nl_msg);
 char **key_value_to_env(key_value_t *kv);
+void key_value_env_free(char **envp);
+char *key_value_get(key_value_t *kv);
 
 int key_value_set(key_value_t *kv, char *key, char *value);
 int key_value_cpy(key_value_t *kv, char *key, char *value);
@@ -27,19 +27,39 @@
 
 #include "defs.h"
 #include "nl_handler.h"
+#include "coldplug.h"
 #include "event.h"
 #include "utils.h"
 #include "log.h"
 #include "fsnotify.h"
+#include "nl_rx.h"
+#include "nl_uring.h"
+#include "pollfd.h"
 
 #define SECS 1000
 
-static struct sigaction sig_act = {};
+/* rules are reloaded once the files are not changed for this time, msecs */
+#define RULES_RELOAD_DELAY 200
+
+enum
+{
+    OPT_RTNL_RCVBUF = 256,
+    OPT_UEVENT_RCVBUF,
+    OPT_RX_RING,
+    OPT_DUMP_EVENTS,
+    OPT_ALL_NSID,
+    OPT_NETNS,
+    OPT_NETNS_ALL,
+    OPT_UDEV_MONITOR,
+    OPT_COLDPLUG,
+};
+
 static int do_exit = 0;
 static int is_foreground = 0;
 static char *pid_file = PID_FILE;
 
 static char *rules_dir = CONF_DIR "/" RULES_DIR;
+static poll_timer_t rules_timer;
 
 nl_handler_t *nl_handlers[] =
 {
@@ -73,7 +93,7 @@ static int create_pidfile()
     return 0;
 }
 
-static void sig_int(int num)
+static void on_exit_signal(int signo, void *arg)
 {
     do_exit = 1;
 }
@@ -85,6 +105,18 @@ static int usage(char *progname)
     printf("-d, --events-dump           prints handled Netlink events in key=value format\n");
     printf("-f, --foreground            runs in foreground with console logging\n");
     printf("-p, --pid-file PATH         specifies pid file\n");
+    printf("    --rtnl-rcvbuf SIZE      RT Netlink socket receive buffer size\n");
+    printf("    --uevent-rcvbuf SIZE    Uevent socket receive buffer size\n");
+    printf("-w, --workers N             matches and runs the programs in N threads\n");
+    printf("-T, --rx-thread             receives Netlink messages in a separate thread\n");
+    printf("    --rx-ring SIZE          receive thread ring size\n");
+    printf("-U, --io-uring              uses io_uring instead of epoll if supported\n");
+    printf("    --dump-events           sends DUMP* events for the existing RT objects\n");
+    printf("    --all-nsid              receives RT events of the namespaces with nsid\n");
+    printf("    --netns NAME            receives RT events of the named namespace\n");
+    printf("    --netns-all             receives RT events of all the named namespaces\n");
+    printf("    --udev-monitor          receives uevents from udevd instead of the kernel\n");
+    printf("    --coldplug scan|trigger sends add uevents for the existing devices\n");
 
     return -1;
 }
@@ -92,16 +124,29 @@ static int usage(char *progname)
 static int parse_opts(int argc, char **argv)
 {
     int c;
+    long size;
     struct option opts_long[] =
     {
         {"events-dump", 0, NULL, 'd'},
         {"rules-dir", 1, NULL, 'r'},
         {"foreground", 0, NULL, 'f'},
         {"pid-file", 1, NULL, 'p'},
+        {"rtnl-rcvbuf", 1, NULL, OPT_RTNL_RCVBUF},
+        {"uevent-rcvbuf", 1, NULL, OPT_UEVENT_RCVBUF},
+        {"workers", 1, NULL, 'w'},
+        {"rx-thread", 0, NULL, 'T'},
+        {"rx-ring", 1, NULL, OPT_RX_RING},
+        {"io-uring", 0, NULL, 'U'},
+        {"dump-events", 0, NULL, OPT_DUMP_EVENTS},
+        {"all-nsid", 0, NULL, OPT_ALL_NSID},
+        {"netns", 1, NULL, OPT_NETNS},
+        {"netns-all", 0, NULL, OPT_NETNS_ALL},
+        {"udev-monitor", 0, NULL, OPT_UDEV_MONITOR},
+        {"coldplug", 1, NULL, OPT_COLDPLUG},
         {NULL, 0, NULL, 0},
     };
 
-    while ((c = getopt_long(argc, argv, "r:df", opts_long, NULL)) != -1)
+    while ((c = getopt_long(argc, argv, "r:dfp:w:TU", opts_long, NULL)) != -1)
     {
         switch (c)
         {
@@ -118,6 +163,55 @@ static int parse_opts(int argc, char **argv)
         case 'p':
             pid_file = optarg;
             break;
+        case OPT_RTNL_RCVBUF:
+        case OPT_UEVENT_RCVBUF:
+            if ((size = str_to_size(optarg)) <= 0)
+                return -1;
+
+            if (c == OPT_RTNL_RCVBUF)
+                rtnl_rcvbuf = size;
+            else
+                udev_rcvbuf = size;
+            break;
+        case 'w':
+            if ((event_workers = atoi(optarg)) < 0)
+                return -1;
+            break;
+        case 'T':
+            nl_rx_thread = 1;
+            break;
+        case OPT_RX_RING:
+            if ((size = str_to_size(optarg)) <= 0)
+                return -1;
+
+            nl_rx_ring_size = size;
+            break;
+        case 'U':
+            poll_uring = 1;
+            break;
+        case OPT_DUMP_EVENTS:
+            rtnl_dump_events = 1;
+            break;
+        case OPT_ALL_NSID:
+            rtnl_all_nsid = 1;
+            break;
+        case OPT_NETNS:
+            rtnl_netns_add(optarg);
+            break;
+        case OPT_NETNS_ALL:
+            rtnl_netns_all = 1;
+            break;
+        case OPT_UDEV_MONITOR:
+            udev_monitor = 1;
+            break;
+        case OPT_COLDPLUG:
+            if (!strcmp(optarg, "scan"))
+                udev_coldplug = COLDPLUG_SCAN;
+            else if (!strcmp(optarg, "trigger"))
+                udev_coldplug = COLDPLUG_TRIGGER;
+            else
+                return -1;
+            break;
         default:
             return -1;
         }
@@ -166,23 +260,37 @@ static void daemonize(void)
     close(STDERR_FILENO);
 }
 
-static void on_rules_changed(struct inotify_event *e, void *arg)
+static void rules_reload(void)
 {
     nlevtd_log(LOG_INFO, "Reloading rules ...\n");
 
+    poll_timer_del(&rules_timer);
     event_rules_unload();
 
     if (event_rules_load(rules_dir))
         nlevtd_log(LOG_ERR, "Error while parsing rules\n");
+
+    nl_handlers_rules_changed(nl_handlers);
 }
 
-int main(int argc, char **argv)
+static void on_rules_timer(poll_timer_t *timer, void *arg)
 {
-    sig_act.sa_handler = sig_int;
-    sigaction(SIGINT, &sig_act, 0);
-    sigaction(SIGTERM, &sig_act, 0);
-    sigaction(SIGQUIT, &sig_act, 0);
+    rules_reload();
+}
 
+static void on_reload_signal(int signo, void *arg)
+{
+    rules_reload();
+}
+
+/* a rule file is usually written by several writes, they are waited for */
+static void on_rules_changed(struct inotify_event *e, void *arg)
+{
+    poll_timer_add(&rules_timer, RULES_RELOAD_DELAY);
+}
+
+int main(int argc, char **argv)
+{
     if (parse_opts(argc, argv))
         return usage(argv[0]);
 
@@ -191,12 +299,29 @@ int main(int argc, char **argv)
 
     log_open();
 
+    /* the signals are handled by the event loop, they are blocked until it
+     * runs */
+    if (poll_register_signal(SIGINT, on_exit_signal, NULL) ||
+            poll_register_signal(SIGTERM, on_exit_signal, NULL) ||
+            poll_register_signal(SIGQUIT, on_exit_signal, NULL) ||
+            poll_register_signal(SIGHUP, on_reload_signal, NULL))
+    {
+        return nlevtd_log(LOG_ERR, "Error while setting signal handlers\n");
+    }
+
+    poll_timer_init(&rules_timer, on_rules_timer, NULL);
+
+    if (event_workers_init())
+        return nlevtd_log(LOG_ERR, "Error while starting workers\n");
+
     if (nl_handlers_init(nl_handlers))
         return nlevtd_log(LOG_ERR, "Error while initialize netlink handlers\n");
 
     if (event_rules_load(rules_dir))
         return nlevtd_log(LOG_ERR, "Error while parsing rules\n");
 
+    nl_handlers_rules_changed(nl_handlers);
+
     if (!is_foreground && create_pidfile())
     {
         return nlevtd_log(LOG_ERR, "Can't create pid file %s: %s\n", pid_file,
@@ -205,21 +330,30 @@ int main(int argc, char **argv)
 
     fsnotify_register_handler(rules_dir, 0, on_rules_changed, NULL);
 
-    /* fsnotify handlers should be registered before fsnotify_init */
     fsnotify_init();
 
-    /* poll handlers should be registered before poll_init */
-    poll_init();
+    if (nl_rx_thread && nl_rx_start())
+        return nlevtd_log(LOG_ERR, "Error while starting receive thread\n");
+
+    if (poll_init())
+        return nlevtd_log(LOG_ERR, "Error while initializing event loop\n");
 
     nlevtd_log(LOG_INFO, "Waiting for the Netlink events ...\n");
 
     while (!do_exit)
-        poll_events();
+    {
+        if (poll_events())
+            break;
+    }
 
     nlevtd_log(LOG_INFO, "Exiting ...\n");
 
+    nl_rx_stop();
+    event_runs_cleanup();
+    nl_uring_cleanup();
     poll_cleanup();
     fsnotify_cleanup();
+    event_workers_cleanup();
     nl_handlers_cleanup(nl_handlers);
     event_rules_unload();
     unlink(pid_file);
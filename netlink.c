@@ -20,8 +20,16 @@
 #include <stdlib.h>
 #include <sys/socket.h>
 #include <string.h>
+#include <poll.h>
+#include <linux/rtnetlink.h>
+
+#ifndef SOL_NETLINK
+#define SOL_NETLINK 270
+#endif
 
 #include "netlink.h"
+#include "nl_rx.h"
+#include "nl_uring.h"
 #include "log.h"
 #include "pollfd.h"
 
@@ -31,8 +39,10 @@ nl_sock_t *nl_sock_create(int proto, int groups)
     int sock = -1;
     nl_sock_t *nl_sock = NULL;
     struct iovec *iov;
+    int i;
 
-    if ((sock = socket(AF_NETLINK, SOCK_RAW, proto)) < 0)
+    if ((sock = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                    proto)) < 0)
     {
         nlevtd_log(LOG_ERR, "Can't create Netlink socket: %s\n",
                 strerror(errno));
@@ -44,7 +54,9 @@ nl_sock_t *nl_sock_create(int proto, int groups)
 
     nl_addr->nl_family = AF_NETLINK;
     nl_addr->nl_groups = groups;
-    nl_addr->nl_pid = getpid();
+    /* let the kernel assign an unique port id, there may be several
+     * sockets of the same protocol */
+    nl_addr->nl_pid = 0;
 
     if (bind(sock, (struct sockaddr *)nl_addr, sizeof(*nl_addr)) < 0)
     {
@@ -54,20 +66,29 @@ nl_sock_t *nl_sock_create(int proto, int groups)
     }
 
     nl_sock = (nl_sock_t *)malloc(sizeof(nl_sock_t));
+    memset(nl_sock, 0, sizeof(nl_sock_t));
 
-    nl_sock->msg_hdr = (struct msghdr *)malloc(sizeof(struct msghdr));
-    nl_sock->msg_hdr->msg_name = nl_addr;
-    nl_sock->msg_hdr->msg_namelen = sizeof(*nl_addr);
-    nl_sock->msg_hdr->msg_iov = NULL;
     nl_sock->addr = nl_addr;
     nl_sock->sock = sock;
+    nl_sock->batch = NL_BATCH_MAX;
+    nl_sock->buf_size = NL_MSG_MAX;
+
+    nl_sock->msgs = (struct mmsghdr *)calloc(nl_sock->batch,
+            sizeof(struct mmsghdr));
+    nl_sock->names = (struct sockaddr_nl *)calloc(nl_sock->batch,
+            sizeof(struct sockaddr_nl));
+    iov = (struct iovec *)calloc(nl_sock->batch, sizeof(struct iovec));
 
-    iov = (struct iovec *)malloc( sizeof(struct iovec));
-    iov->iov_base = malloc(NL_MSG_MAX);
-    iov->iov_len = NL_MSG_MAX;
+    for (i = 0; i < nl_sock->batch; i++)
+    {
+        iov[i].iov_base = malloc(nl_sock->buf_size + 1);
+        iov[i].iov_len = nl_sock->buf_size;
 
-    nl_sock->msg_hdr->msg_iov = iov;
-    nl_sock->msg_hdr->msg_iovlen = 1;
+        nl_sock->msgs[i].msg_hdr.msg_name = &nl_sock->names[i];
+        nl_sock->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_nl);
+        nl_sock->msgs[i].msg_hdr.msg_iov = &iov[i];
+        nl_sock->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
 
     return nl_sock;
 
@@ -75,25 +96,52 @@ Error:
     if (sock >= 0)
         close(sock);
 
+    free(nl_addr);
     return NULL;
 }
 
 void nl_sock_free(nl_sock_t *nl_sock)
 {
+    int i;
+
     if (!nl_sock)
         return;
 
-    if (nl_sock->msg_hdr)
+    /* no stats for the short living dump sockets */
+    if (nl_sock->addr->nl_groups)
     {
-        if (nl_sock->msg_hdr->msg_iov)
-        {
-            free(nl_sock->msg_hdr->msg_iov->iov_base);
-            free(nl_sock->msg_hdr->msg_iov);
-        }
+        nlevtd_log(LOG_INFO, "Netlink socket %d: %lu wakeups, %lu datagrams, "
+                "%lu truncated, %lu overruns, %d bytes buffers\n",
+                nl_sock->sock, nl_sock->rx_wakeups, nl_sock->rx_msgs,
+                nl_sock->rx_truncated, nl_sock->rx_overruns,
+                nl_sock->buf_size);
+    }
+
+    /* io_uring receives without the syscalls */
+    if (nl_sock->addr->nl_groups && nl_sock->rx_calls)
+    {
+        nlevtd_log(LOG_INFO, "Netlink socket %d: %lu recvmmsg calls, %.1f "
+                "datagrams per call, %lu full batches\n", nl_sock->sock,
+                nl_sock->rx_calls, (double)nl_sock->rx_msgs / nl_sock->rx_calls,
+                nl_sock->rx_full);
+    }
+
+    if (nl_sock->msgs)
+    {
+        for (i = 0; i < nl_sock->batch; i++)
+            free(nl_sock->msgs[i].msg_hdr.msg_iov->iov_base);
 
-        free(nl_sock->msg_hdr);
+        /* all the iovecs were allocated as a single array */
+        free(nl_sock->msgs[0].msg_hdr.msg_iov);
+        free(nl_sock->msgs);
     }
 
+    if (nl_sock->names)
+        free(nl_sock->names);
+
+    if (nl_sock->ctrls)
+        free(nl_sock->ctrls);
+
     if (nl_sock->addr)
         free(nl_sock->addr);
 
@@ -103,23 +151,472 @@ void nl_sock_free(nl_sock_t *nl_sock)
     free(nl_sock);
 }
 
-static void on_nl_sock_poll(int sock, void *arg)
+int nl_sock_rcvbuf_set(nl_sock_t *nl_sock, int size)
 {
-    nl_sock_t *nl_sock = (nl_sock_t *)arg;
-    int rcv_len = recvmsg(nl_sock->sock, nl_sock->msg_hdr, 0);
+    int real_size;
+    socklen_t len = sizeof(real_size);
 
-    if (rcv_len <= 0)
-        return;
+    /* SO_RCVBUFFORCE ignores net.core.rmem_max but needs CAP_NET_ADMIN */
+    if (setsockopt(nl_sock->sock, SOL_SOCKET, SO_RCVBUFFORCE, &size,
+                sizeof(size)) &&
+        setsockopt(nl_sock->sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)))
+    {
+        return nlevtd_log(LOG_ERR, "Can't set Netlink socket receive buffer: "
+                "%s\n", strerror(errno));
+    }
 
-    if (nl_sock->msg_hdr->msg_namelen != sizeof(*nl_sock->addr))
-        return;
+    if (!getsockopt(nl_sock->sock, SOL_SOCKET, SO_RCVBUF, &real_size, &len))
+    {
+        nlevtd_log(LOG_DEBUG, "Netlink socket %d: receive buffer %d bytes\n",
+                nl_sock->sock, real_size);
+    }
+
+    return 0;
+}
+
+/*
+ * Receives the notifications of all the network namespaces which have an
+ * nsid assigned in the own one, the nsid comes as the control message.
+ */
+int nl_sock_listen_all_nsid(nl_sock_t *nl_sock)
+{
+    int i, on = 1;
+
+    if (setsockopt(nl_sock->sock, SOL_NETLINK, NETLINK_LISTEN_ALL_NSID, &on,
+                sizeof(on)))
+    {
+        return nlevtd_log(LOG_ERR, "Can't listen all network namespaces: "
+                "%s\n", strerror(errno));
+    }
+
+    nl_sock->ctrls = (char *)calloc(nl_sock->batch, NL_CTRL_SIZE);
+
+    for (i = 0; i < nl_sock->batch; i++)
+    {
+        nl_sock->msgs[i].msg_hdr.msg_control = nl_sock->ctrls +
+            i * NL_CTRL_SIZE;
+        nl_sock->msgs[i].msg_hdr.msg_controllen = NL_CTRL_SIZE;
+    }
+
+    return 0;
+}
+
+/*
+ * Joins and leaves the multicast groups, groups is the bitmask the same as
+ * nl_groups of the address (bit 0 is group 1). Current groups are kept in the
+ * socket address.
+ */
+int nl_sock_groups_set(nl_sock_t *nl_sock, unsigned int groups)
+{
+    unsigned int changed = groups ^ nl_sock->addr->nl_groups;
+    unsigned int bit;
+    int group, opt;
+
+    for (group = 1; changed; group++, changed >>= 1)
+    {
+        if (!(changed & 1))
+            continue;
+
+        bit = 1u << (group - 1);
+        opt = groups & bit ? NETLINK_ADD_MEMBERSHIP : NETLINK_DROP_MEMBERSHIP;
+
+        if (setsockopt(nl_sock->sock, SOL_NETLINK, opt, &group, sizeof(group)))
+        {
+            return nlevtd_log(LOG_ERR, "Can't %s Netlink group %d: %s\n",
+                    groups & bit ? "join" : "leave", group, strerror(errno));
+        }
+
+        nl_sock->addr->nl_groups ^= bit;
+    }
+
+    return 0;
+}
+
+int nl_msg_nsid(struct msghdr *hdr)
+{
+    struct cmsghdr *cmsg;
+
+    for (cmsg = CMSG_FIRSTHDR(hdr); cmsg; cmsg = CMSG_NXTHDR(hdr, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_NETLINK &&
+                cmsg->cmsg_type == NETLINK_LISTEN_ALL_NSID)
+        {
+            return *(int *)CMSG_DATA(cmsg);
+        }
+    }
+
+    return NL_NSID_NONE;
+}
+
+static void nl_sock_bufs_grow(nl_sock_t *nl_sock, int size)
+{
+    struct iovec *iov;
+    int i;
+
+    /* round up to the page size to not grow on every next byte */
+    size = (size + 4095) & ~4095;
+
+    for (i = 0; i < nl_sock->batch; i++)
+    {
+        iov = nl_sock->msgs[i].msg_hdr.msg_iov;
+
+        free(iov->iov_base);
+        iov->iov_base = malloc(size + 1);
+        iov->iov_len = size;
+    }
+
+    nlevtd_log(LOG_DEBUG, "Netlink socket %d: receive buffers grown from %d "
+            "to %d bytes\n", nl_sock->sock, nl_sock->buf_size, size);
+
+    nl_sock->buf_size = size;
+}
+
+/*
+ * Drains the socket by receiving up to nl_sock->batch datagrams per
+ * recvmmsg() call, so a burst of events costs one wakeup and a few syscalls
+ * instead of one wakeup and one syscall per datagram. Each datagram is passed
+ * to recv_cb, lost_cb is called if some datagrams were lost.
+ */
+void nl_sock_drain(nl_sock_t *nl_sock, nl_msg_handler_t recv_cb,
+    void (*lost_cb)(nl_sock_t *nl_sock))
+{
+    struct msghdr *hdr;
+    int i, count, len;
+    int lost = 0;
+
+    nl_sock->rx_wakeups++;
+
+    /* make sure the head datagram fits, the rest ones are checked below */
+    len = recv(nl_sock->sock, NULL, 0, MSG_PEEK | MSG_TRUNC);
+
+    if (len < 0 && errno == ENOBUFS)
+    {
+        nl_sock->rx_overruns++;
+        lost = 1;
+    }
+    else if (len > nl_sock->buf_size)
+    {
+        nl_sock_bufs_grow(nl_sock, len);
+    }
+
+    for (;;)
+    {
+        /* with MSG_TRUNC msg_len is the real datagram length */
+        count = recvmmsg(nl_sock->sock, nl_sock->msgs, nl_sock->batch,
+                MSG_TRUNC, NULL);
+
+        if (count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            /* the kernel dropped messages, the queued ones are still valid */
+            if (errno == ENOBUFS)
+            {
+                nl_sock->rx_overruns++;
+                lost = 1;
+                continue;
+            }
+
+            break;
+        }
+
+        nl_sock->rx_calls++;
+        nl_sock->rx_msgs += count;
+
+        len = 0;
+
+        for (i = 0; i < count; i++)
+        {
+            hdr = &nl_sock->msgs[i].msg_hdr;
+
+            if (nl_sock->msgs[i].msg_len > nl_sock->buf_size)
+            {
+                nlevtd_log(LOG_WARNING, "Netlink socket %d: truncated %u "
+                        "bytes datagram\n", nl_sock->sock,
+                        nl_sock->msgs[i].msg_len);
+
+                nl_sock->rx_truncated++;
+                lost = 1;
+
+                if (nl_sock->msgs[i].msg_len > len)
+                    len = nl_sock->msgs[i].msg_len;
+            }
+            else if (hdr->msg_namelen == sizeof(struct sockaddr_nl) &&
+                    nl_sock->msgs[i].msg_len > 0)
+            {
+                recv_cb(nl_sock, hdr->msg_iov->iov_base,
+                        nl_sock->msgs[i].msg_len,
+                        nl_sock->ctrls ? nl_msg_nsid(hdr) : NL_NSID_NONE);
+
+                /* destroyed by the callback */
+                if (nl_sock->dead)
+                    return;
+            }
+
+            hdr->msg_namelen = sizeof(struct sockaddr_nl);
+
+            if (nl_sock->ctrls)
+                hdr->msg_controllen = NL_CTRL_SIZE;
+        }
+
+        if (len)
+            nl_sock_bufs_grow(nl_sock, len);
+
+        /* short batch means the socket queue is drained */
+        if (count < nl_sock->batch)
+            break;
+
+        nl_sock->rx_full++;
+    }
+
+    /* report the loss once the queue is drained so recovery sees no stale
+     * messages behind it */
+    if (lost)
+    {
+        nlevtd_log(LOG_WARNING, "Netlink socket %d: events were lost\n",
+                nl_sock->sock);
 
-    nl_sock->recv(nl_sock, nl_sock->msg_hdr->msg_iov->iov_base, rcv_len);
+        if (lost_cb)
+            lost_cb(nl_sock);
+    }
+}
+
+void nl_sock_recv(nl_sock_t *nl_sock)
+{
+    nl_sock_drain(nl_sock, nl_sock->recv, nl_sock->lost);
+}
+
+static void on_nl_sock_poll(int sock, void *arg)
+{
+    nl_sock_recv((nl_sock_t *)arg);
 }
 
 void nl_sock_register_cb(nl_sock_t *nl_sock,
-    void (*recv)(nl_sock_t *nl_sock, void *buf, int len))
+    void (*recv)(nl_sock_t *nl_sock, void *buf, int len, int nsid))
 {
     nl_sock->recv = recv;
-    poll_register_handler(nl_sock->sock, on_nl_sock_poll, nl_sock);
+
+    if (nl_rx_thread)
+    {
+        nl_rx_register(nl_sock);
+        nl_sock->rx_mode = NL_RX_THREAD;
+    }
+    else if (poll_uring_active() && !nl_uring_register(nl_sock))
+    {
+        nl_sock->rx_mode = NL_RX_URING;
+    }
+    else
+    {
+        poll_register_handler_flags(nl_sock->sock, POLL_EDGE,
+                on_nl_sock_poll, nl_sock);
+        nl_sock->rx_mode = NL_RX_POLL;
+    }
+}
+
+static void nl_sock_release(void *arg)
+{
+    nl_sock_free((nl_sock_t *)arg);
+}
+
+/*
+ * Stops receiving the registered socket and frees it once no handler refers
+ * to it, so it may be called from any callback, the own recv one too.
+ */
+void nl_sock_destroy(nl_sock_t *nl_sock)
+{
+    /* the receive thread frees it after the queued datagrams */
+    if (nl_sock->rx_mode == NL_RX_THREAD)
+    {
+        nl_rx_unregister(nl_sock);
+        return;
+    }
+
+    nl_sock->dead = 1;
+
+    if (nl_sock->rx_mode == NL_RX_URING)
+        nl_uring_unregister(nl_sock);
+    else
+        poll_unregister_handler(nl_sock->sock);
+
+    poll_release(nl_sock_release, nl_sock);
+}
+
+void nl_sock_register_lost_cb(nl_sock_t *nl_sock,
+    void (*lost)(nl_sock_t *nl_sock))
+{
+    nl_sock->lost = lost;
+}
+
+typedef struct nl_dump_ctx
+{
+    unsigned int seq;
+    int done;
+    int error;
+    int intr;
+    void (*func)(struct nlmsghdr *msg, void *arg);
+    void *arg;
+} nl_dump_ctx_t;
+
+static void nl_dump_recv(nl_sock_t *nl_sock, void *buf, int len, int nsid)
+{
+    nl_dump_ctx_t *ctx = (nl_dump_ctx_t *)nl_sock->obj;
+    struct nlmsghdr *msg;
+
+    for (msg = (struct nlmsghdr *)buf; NLMSG_OK(msg, len) && !ctx->done;
+            msg = NLMSG_NEXT(msg, len))
+    {
+        if (msg->nlmsg_seq != ctx->seq)
+            continue;
+
+        if (msg->nlmsg_type == NLMSG_DONE)
+        {
+            ctx->done = 1;
+        }
+        else if (msg->nlmsg_type == NLMSG_ERROR)
+        {
+            ctx->error = -((struct nlmsgerr *)NLMSG_DATA(msg))->error;
+            ctx->done = 1;
+        }
+        else
+        {
+            if (msg->nlmsg_flags & NLM_F_DUMP_INTR)
+                ctx->intr = 1;
+
+            ctx->func(msg, ctx->arg);
+        }
+    }
+}
+
+/* the objects of the lost datagrams would look removed, the dump fails */
+static void nl_dump_lost(nl_sock_t *nl_sock)
+{
+    nl_dump_ctx_t *ctx = (nl_dump_ctx_t *)nl_sock->obj;
+
+    if (!ctx->error)
+        ctx->error = nl_sock->rx_truncated ? EMSGSIZE : ENOBUFS;
+}
+
+/*
+ * Runs the dumps of all the types at once, each dump has its own socket as
+ * the kernel serves a single dump per socket. The messages are passed to
+ * func in the order they come from the sockets, so the messages of
+ * the different types may be interleaved.
+ */
+int nl_dump(int proto, const int *types, int count, int family,
+    void (*func)(struct nlmsghdr *msg, void *arg), void *arg)
+{
+    static unsigned int seq = 0;
+    struct
+    {
+        struct nlmsghdr hdr;
+        struct rtgenmsg gen;
+    } req;
+    struct sockaddr_nl kernel = { .nl_family = AF_NETLINK };
+    nl_dump_ctx_t ctx[NL_DUMP_MAX];
+    nl_sock_t *socks[NL_DUMP_MAX];
+    struct pollfd pfd[NL_DUMP_MAX];
+    int i, ret, pending = 0, err = 0;
+
+    if (count > NL_DUMP_MAX)
+        return nlevtd_log(LOG_ERR, "Too many Netlink dumps: %d\n", count);
+
+    memset(ctx, 0, sizeof(ctx));
+    memset(&req, 0, sizeof(req));
+    req.hdr.nlmsg_len = NLMSG_LENGTH(sizeof(req.gen));
+    req.hdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.gen.rtgen_family = family;
+
+    for (i = 0; i < count; i++)
+    {
+        ctx[i].seq = ++seq;
+        ctx[i].func = func;
+        ctx[i].arg = arg;
+        ctx[i].done = 1;
+
+        if (!(socks[i] = nl_sock_create(proto, 0)))
+        {
+            ctx[i].error = errno;
+            continue;
+        }
+
+        socks[i]->recv = nl_dump_recv;
+        socks[i]->lost = nl_dump_lost;
+        socks[i]->obj = &ctx[i];
+
+        /* kernel sizes the dump datagrams by the receive buffers */
+        nl_sock_bufs_grow(socks[i], NL_DUMP_BUF);
+
+        req.hdr.nlmsg_type = types[i];
+        req.hdr.nlmsg_seq = ctx[i].seq;
+
+        if (sendto(socks[i]->sock, &req, req.hdr.nlmsg_len, 0,
+                    (struct sockaddr *)&kernel, sizeof(kernel)) < 0)
+        {
+            ctx[i].error = errno;
+            continue;
+        }
+
+        ctx[i].done = 0;
+        pending++;
+    }
+
+    while (pending)
+    {
+        for (i = 0; i < count; i++)
+        {
+            pfd[i].fd = ctx[i].done ? -1 : socks[i]->sock;
+            pfd[i].events = POLLIN;
+            pfd[i].revents = 0;
+        }
+
+        ret = poll(pfd, count, NL_DUMP_TIMEOUT);
+
+        if (ret < 0 && errno == EINTR)
+            continue;
+
+        if (ret <= 0)
+        {
+            ret = ret ? errno : ETIMEDOUT;
+
+            for (i = 0; i < count; i++)
+            {
+                if (!ctx[i].done)
+                    ctx[i].error = ret;
+            }
+
+            break;
+        }
+
+        for (i = 0; i < count; i++)
+        {
+            if (ctx[i].done || !pfd[i].revents)
+                continue;
+
+            nl_sock_recv(socks[i]);
+
+            if (ctx[i].done)
+                pending--;
+        }
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        if (socks[i])
+            nl_sock_free(socks[i]);
+
+        if (ctx[i].intr)
+        {
+            nlevtd_log(LOG_WARNING, "Netlink dump of type %d was interrupted "
+                    "by changes\n", types[i]);
+        }
+
+        if (ctx[i].error)
+        {
+            err = nlevtd_log(LOG_ERR, "Netlink dump of type %d failed: %s\n",
+                    types[i], strerror(ctx[i].error));
+        }
+    }
+
+    return err;
 }
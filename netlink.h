@@ -18,25 +18,95 @@
 #ifndef _NETLINK_H_
 #define _NETLINK_H_
 
+#include <sys/socket.h>
 #include <linux/netlink.h>
 
+/* initial size of the receive buffers, they grow on demand */
 #define NL_MSG_MAX 4096
 
+/* max number of datagrams received by a single recvmmsg() call */
+#define NL_BATCH_MAX 32
+
+/* default kernel receive buffer sizes */
+#define NL_RCVBUF_RTNL (4 * 1024 * 1024)
+#define NL_RCVBUF_UEVENT (1024 * 1024)
+
+/* max time to wait for the next part of a dump, in msecs */
+#define NL_DUMP_TIMEOUT 5000
+
+/* max number of dumps run at once */
+#define NL_DUMP_MAX 8
+
+/* receive buffers size of the dump sockets */
+#define NL_DUMP_BUF (32 * 1024)
+
+/* datagram came from the own network namespace */
+#define NL_NSID_NONE -1
+
+/* how the datagrams of the registered socket are received */
+#define NL_RX_POLL 0
+#define NL_RX_THREAD 1
+#define NL_RX_URING 2
+
+/* control buffer size for the peer nsid */
+#define NL_CTRL_SIZE CMSG_SPACE(sizeof(int))
+
 typedef struct nl_sock
 {
     int sock;
-    struct msghdr *msg_hdr;
     struct sockaddr_nl *addr;
-    void (*recv)(struct nl_sock *s, void *buf, int len);
+    struct mmsghdr *msgs;
+    struct sockaddr_nl *names;
+    int batch;
+    /* control buffers, allocated when the peer nsid is received */
+    char *ctrls;
+    /*
+     * Size of each receive buffer, the buffers have one spare byte past it
+     * so the handlers may NUL-terminate the received data.
+     */
+    int buf_size;
+    /* nsid is the peer namespace of the datagram or NL_NSID_NONE */
+    void (*recv)(struct nl_sock *s, void *buf, int len, int nsid);
+    /* called when the kernel dropped or truncated some datagrams */
+    void (*lost)(struct nl_sock *s);
     void *obj;
+
+    /* receive statistics */
+    unsigned long rx_wakeups;
+    unsigned long rx_calls;
+    unsigned long rx_msgs;
+    /* recvmmsg() calls which filled the whole batch */
+    unsigned long rx_full;
+    unsigned long rx_truncated;
+    unsigned long rx_overruns;
+
+    /* receive thread could not queue some datagrams */
+    int rx_ring_lost;
+
+    int rx_mode;
+    /* destroyed, no more datagrams are passed to recv */
+    int dead;
 } nl_sock_t;
 
-typedef void (*nl_msg_handler_t)(nl_sock_t *nl_sock, void *buf, int len);
+typedef void (*nl_msg_handler_t)(nl_sock_t *nl_sock, void *buf, int len,
+    int nsid);
 
 nl_sock_t *nl_sock_create(int proto, int groups);
 void nl_sock_free(nl_sock_t *nl_sock);
+void nl_sock_destroy(nl_sock_t *nl_sock);
+int nl_sock_rcvbuf_set(nl_sock_t *nl_sock, int size);
+int nl_sock_listen_all_nsid(nl_sock_t *nl_sock);
+int nl_sock_groups_set(nl_sock_t *nl_sock, unsigned int groups);
+int nl_msg_nsid(struct msghdr *hdr);
 void nl_sock_register_cb(nl_sock_t *nl_sock,
-    void (*recv)(nl_sock_t *nl_sock, void *buf, int len));
+    void (*recv)(nl_sock_t *nl_sock, void *buf, int len, int nsid));
+void nl_sock_register_lost_cb(nl_sock_t *nl_sock,
+    void (*lost)(nl_sock_t *nl_sock));
+void nl_sock_drain(nl_sock_t *nl_sock, nl_msg_handler_t recv_cb,
+    void (*lost_cb)(nl_sock_t *nl_sock));
+void nl_sock_recv(nl_sock_t *nl_sock);
+int nl_dump(int proto, const int *types, int count, int family,
+    void (*func)(struct nlmsghdr *msg, void *arg), void *arg);
 
 #define for_each_nlmsg(buf, nlmsg, len) \
         for (nlmsg = (struct nlmsghdr *)buf; \
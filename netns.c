@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2013 Vadim Kochan <vadim4j@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "netns.h"
+#include "log.h"
+
+/* network namespace nleventd was started in */
+static int netns_home = -1;
+
+int netns_init(void)
+{
+    if (netns_home >= 0)
+        return 0;
+
+    if ((netns_home = open("/proc/self/ns/net", O_RDONLY | O_CLOEXEC)) < 0)
+    {
+        return nlevtd_log(LOG_ERR, "Can't open own network namespace: %s\n",
+                strerror(errno));
+    }
+
+    return 0;
+}
+
+void netns_cleanup(void)
+{
+    if (netns_home >= 0)
+        close(netns_home);
+
+    netns_home = -1;
+}
+
+int netns_open(char *name)
+{
+    char path[PATH_MAX];
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/%s", NETNS_RUN_DIR, name);
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+    {
+        nlevtd_log(LOG_ERR, "Can't open network namespace %s: %s\n", name,
+                strerror(errno));
+    }
+
+    return fd;
+}
+
+/* checks if the name still refers to the namespace opened as fd */
+int netns_is_named(int fd, char *name)
+{
+    char path[PATH_MAX];
+    struct stat st_name, st_fd;
+
+    snprintf(path, sizeof(path), "%s/%s", NETNS_RUN_DIR, name);
+
+    if (stat(path, &st_name) || fstat(fd, &st_fd))
+        return 0;
+
+    return st_name.st_dev == st_fd.st_dev && st_name.st_ino == st_fd.st_ino;
+}
+
+/*
+ * Moves the calling thread to the namespace, fd < 0 means the own namespace.
+ * The sockets which are created after that belong to the namespace.
+ */
+int netns_enter(int fd)
+{
+    if (fd < 0)
+        fd = netns_home;
+
+    if (setns(fd, CLONE_NEWNET))
+    {
+        return nlevtd_log(LOG_ERR, "Can't enter network namespace: %s\n",
+                strerror(errno));
+    }
+
+    return 0;
+}
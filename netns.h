@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2013 Vadim Kochan <vadim4j@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _NETNS_H_
+#define _NETNS_H_
+
+/* named network namespaces as created by "ip netns add" */
+#define NETNS_RUN_DIR "/run/netns"
+
+int netns_init(void);
+void netns_cleanup(void);
+int netns_open(char *name);
+int netns_is_named(int fd, char *name);
+int netns_enter(int fd);
+
+#endif /* _NETNS_H_ */
@@ -36,6 +36,17 @@ int nl_handlers_init(nl_handler_t **hlist)
     return 0;
 }
 
+void nl_handlers_rules_changed(nl_handler_t **hlist)
+{
+    int i;
+
+    for (i = 0; hlist[i]; i++)
+    {
+        if (hlist[i]->do_rules_changed)
+            hlist[i]->do_rules_changed();
+    }
+}
+
 void nl_handlers_cleanup(nl_handler_t **hlist)
 {
     int i;
@@ -25,12 +25,33 @@ typedef struct
 {
     void (* do_init)(void);
     void (* do_cleanup)(void);
+    /* called after the rules were (re)loaded */
+    void (* do_rules_changed)(void);
 } nl_handler_t;
 
 extern nl_handler_t rtnl_handler_ops;
 extern nl_handler_t udev_handler_ops;
 
+/* kernel receive buffer sizes of the handlers sockets */
+extern int rtnl_rcvbuf;
+extern int udev_rcvbuf;
+
+/* receive the uevents from udevd (libudev monitor) instead of the kernel */
+extern int udev_monitor;
+
+/* report the devices which exist at start by add uevents (COLDPLUG_*) */
+extern int udev_coldplug;
+
+/* send DUMP* events for the RT objects which exist at start */
+extern int rtnl_dump_events;
+
+/* RT events of the other network namespaces */
+extern int rtnl_all_nsid;
+extern int rtnl_netns_all;
+int rtnl_netns_add(char *name);
+
 int nl_handlers_init(nl_handler_t **handlers);
 void nl_handlers_cleanup(nl_handler_t **handlers);
+void nl_handlers_rules_changed(nl_handler_t **handlers);
 
 #endif /* _NL_HANDLER_H_ */
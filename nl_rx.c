@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2013 Vadim Kochan <vadim4j@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Receive thread which keeps the kernel socket queues drained while the
+ * events are parsed and dispatched by the main thread. Datagrams are copied
+ * into the single-producer single-consumer ring, the main thread is woken up
+ * via eventfd.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "nl_rx.h"
+#include "ring.h"
+#include "pollfd.h"
+#include "log.h"
+
+#define RX_EVENTS_MAX 16
+
+/* ring record header, len < 0 means that the datagrams were lost */
+typedef struct rx_rec
+{
+    nl_sock_t *nl_sock;
+    int len;
+    int nsid;
+} rx_rec_t;
+
+/* destroyed socket, freed once the datagrams queued before are consumed */
+typedef struct rx_dead
+{
+    nl_sock_t *nl_sock;
+    unsigned int pos;
+    struct rx_dead *next;
+} rx_dead_t;
+
+int nl_rx_thread = 0;
+unsigned int nl_rx_ring_size = NL_RX_RING_SIZE;
+
+static int rx_epfd = -1;
+static int rx_stop_fd = -1;
+static int rx_wake_fd = -1;
+static int rx_running = 0;
+static pthread_t rx_tid;
+static ring_t rx_ring;
+static rx_dead_t *rx_dead_list = NULL;
+/* held while the thread drains the sockets, dead flag is changed under it */
+static pthread_mutex_t rx_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void rx_put(nl_sock_t *nl_sock, void *buf, int len, int nsid)
+{
+    rx_rec_t rec = { .nl_sock = nl_sock, .len = len,
+        .nsid = nsid };
+
+    /* the spare byte of the buffer goes too, handlers may NUL-terminate */
+    if (ring_put(&rx_ring, &rec, sizeof(rec), buf, len + 1))
+        nl_sock->rx_ring_lost = 1;
+}
+
+static void rx_lost(nl_sock_t *nl_sock)
+{
+    nl_sock->rx_ring_lost = 1;
+}
+
+static void *rx_thread_run(void *arg)
+{
+    struct epoll_event events[RX_EVENTS_MAX];
+    rx_rec_t lost_rec = { .len = -1 };
+    uint64_t one = 1;
+    nl_sock_t *nl_sock;
+    sigset_t sigs;
+    int i, count;
+
+    /* signals are handled by the main thread */
+    sigfillset(&sigs);
+    pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+
+    for (;;)
+    {
+        count = epoll_wait(rx_epfd, events, RX_EVENTS_MAX, -1);
+
+        if (count < 0 && errno == EINTR)
+            continue;
+
+        if (count < 0)
+        {
+            nlevtd_log(LOG_ERR, "Receive thread epoll_wait(): %s\n",
+                    strerror(errno));
+            break;
+        }
+
+        pthread_mutex_lock(&rx_lock);
+
+        for (i = 0; i < count; i++)
+        {
+            /* stop request */
+            if (!(nl_sock = (nl_sock_t *)events[i].data.ptr))
+            {
+                pthread_mutex_unlock(&rx_lock);
+                return NULL;
+            }
+
+            /* destroyed after epoll_wait() returned it */
+            if (nl_sock->dead)
+                continue;
+
+            nl_sock_drain(nl_sock, rx_put, rx_lost);
+
+            /* the loss is reported after the queued datagrams */
+            if (nl_sock->rx_ring_lost)
+            {
+                lost_rec.nl_sock = nl_sock;
+
+                if (!ring_put(&rx_ring, &lost_rec, sizeof(lost_rec), NULL, 0))
+                    nl_sock->rx_ring_lost = 0;
+            }
+        }
+
+        pthread_mutex_unlock(&rx_lock);
+
+        if (write(rx_wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+            nlevtd_log(LOG_ERR, "Can't wake up main thread\n");
+    }
+
+    return NULL;
+}
+
+static void rx_dead_free(int all);
+
+static void on_rx_dead_release(void *arg)
+{
+    rx_dead_free(0);
+}
+
+/* frees the destroyed sockets which have no queued datagrams any more */
+static void rx_dead_free(int all)
+{
+    rx_dead_t **pdead, *dead;
+
+    for (pdead = &rx_dead_list; (dead = *pdead); )
+    {
+        if (!all && !ring_consumed(&rx_ring, dead->pos))
+        {
+            pdead = &dead->next;
+            continue;
+        }
+
+        *pdead = dead->next;
+        nl_sock_free(dead->nl_sock);
+        free(dead);
+    }
+}
+
+static void on_rx_wake(int fd, void *arg)
+{
+    rx_rec_t *rec;
+    unsigned int len;
+    uint64_t count;
+
+    if (read(fd, &count, sizeof(count)) < 0)
+        return;
+
+    while ((rec = (rx_rec_t *)ring_get(&rx_ring, &len)))
+    {
+        if (rec->nl_sock->dead)
+            ;
+        else if (rec->len < 0)
+        {
+            if (rec->nl_sock->lost)
+                rec->nl_sock->lost(rec->nl_sock);
+        }
+        else
+        {
+            rec->nl_sock->recv(rec->nl_sock, rec + 1, rec->len, rec->nsid);
+        }
+
+        ring_consume(&rx_ring, len);
+    }
+
+    rx_dead_free(0);
+}
+
+static int rx_epoll_add(int fd, void *ptr)
+{
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = ptr };
+
+    if (rx_epfd < 0 && (rx_epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+    {
+        return nlevtd_log(LOG_ERR, "Can't create epoll: %s\n",
+                strerror(errno));
+    }
+
+    if (epoll_ctl(rx_epfd, EPOLL_CTL_ADD, fd, &event))
+    {
+        return nlevtd_log(LOG_ERR, "Can't add fd to epoll: %s\n",
+                strerror(errno));
+    }
+
+    return 0;
+}
+
+void nl_rx_register(nl_sock_t *nl_sock)
+{
+    rx_epoll_add(nl_sock->sock, nl_sock);
+}
+
+/*
+ * Once the dead flag is set under the lock the thread doesn't touch the
+ * socket, the records queued before are skipped and the socket is freed after
+ * them.
+ */
+void nl_rx_unregister(nl_sock_t *nl_sock)
+{
+    rx_dead_t *dead;
+
+    epoll_ctl(rx_epfd, EPOLL_CTL_DEL, nl_sock->sock, NULL);
+
+    pthread_mutex_lock(&rx_lock);
+    nl_sock->dead = 1;
+    pthread_mutex_unlock(&rx_lock);
+
+    dead = (rx_dead_t *)malloc(sizeof(rx_dead_t));
+    dead->nl_sock = nl_sock;
+    dead->pos = ring_produced(&rx_ring);
+    dead->next = rx_dead_list;
+    rx_dead_list = dead;
+
+    /* nothing is queued, no wakeup may come to free it */
+    if (ring_consumed(&rx_ring, dead->pos))
+        poll_release(on_rx_dead_release, NULL);
+}
+
+int nl_rx_start(void)
+{
+    if (ring_init(&rx_ring, nl_rx_ring_size))
+        return nlevtd_log(LOG_ERR, "Can't allocate receive ring\n");
+
+    rx_stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    rx_wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    if (rx_stop_fd < 0 || rx_wake_fd < 0)
+        return nlevtd_log(LOG_ERR, "Can't create eventfd: %s\n",
+                strerror(errno));
+
+    if (rx_epoll_add(rx_stop_fd, NULL))
+        return -1;
+
+    poll_register_handler_flags(rx_wake_fd, POLL_EDGE, on_rx_wake, NULL);
+
+    if ((errno = pthread_create(&rx_tid, NULL, rx_thread_run, NULL)))
+    {
+        return nlevtd_log(LOG_ERR, "Can't start receive thread: %s\n",
+                strerror(errno));
+    }
+
+    rx_running = 1;
+    return 0;
+}
+
+void nl_rx_stop(void)
+{
+    uint64_t one = 1;
+
+    if (rx_running)
+    {
+        if (write(rx_stop_fd, &one, sizeof(one)) == sizeof(one))
+            pthread_join(rx_tid, NULL);
+
+        rx_running = 0;
+
+        nlevtd_log(LOG_INFO, "Receive ring: %lu datagrams, %lu drops, max "
+                "%u of %u bytes used\n", rx_ring.puts, rx_ring.drops,
+                rx_ring.max_used, rx_ring.size);
+    }
+
+    if (rx_epfd >= 0)
+        close(rx_epfd);
+
+    if (rx_stop_fd >= 0)
+        close(rx_stop_fd);
+
+    if (rx_wake_fd >= 0)
+        close(rx_wake_fd);
+
+    rx_epfd = rx_stop_fd = rx_wake_fd = -1;
+    rx_dead_free(1);
+    ring_free(&rx_ring);
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2013 Vadim Kochan <vadim4j@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _NL_RX_H_
+#define _NL_RX_H_
+
+#include "netlink.h"
+
+#define NL_RX_RING_SIZE (16 * 1024 * 1024)
+
+extern int nl_rx_thread;
+extern unsigned int nl_rx_ring_size;
+
+void nl_rx_register(nl_sock_t *nl_sock);
+void nl_rx_unregister(nl_sock_t *nl_sock);
+int nl_rx_start(void);
+void nl_rx_stop(void);
+
+#endif /* _NL_RX_H_ */
@@ -0,0 +1,316 @@
+/*
+ * Copyright (C) 2013 Vadim Kochan <vadim4j@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Receives the Netlink datagrams via multishot io_uring recvmsg into the
+ * provided buffers, so a posted receive keeps completing without any syscall
+ * per datagram. If the receive stops (the buffers ran out, the socket was
+ * overrun) the queue is drained by recvmmsg at the end of the pass and the
+ * receive is posted again.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nl_uring.h"
+#include "uring.h"
+#include "pollfd.h"
+#include "log.h"
+
+typedef struct nl_uring
+{
+    /* should be the first */
+    uring_req_t req;
+    nl_sock_t *nl_sock;
+    uring_bufs_t *bufs;
+    struct msghdr msg;
+    /* pass and number of the buffers used during it */
+    unsigned long pass;
+    unsigned int pass_bufs;
+    int armed;
+    int lost;
+    /* the receive failed to be posted, the socket is polled */
+    int polling;
+    /* the socket is destroyed, freed after the last completion */
+    int removed;
+    struct nl_uring *next;
+} nl_uring_t;
+
+static nl_uring_t *nl_urings = NULL;
+static int drain_lost;
+
+static void nl_uring_free(nl_uring_t *nu)
+{
+    nl_uring_t **pnu;
+
+    for (pnu = &nl_urings; *pnu; pnu = &(*pnu)->next)
+    {
+        if (*pnu == nu)
+        {
+            *pnu = nu->next;
+            break;
+        }
+    }
+
+    uring_bufs_free(nu->bufs);
+    free(nu);
+}
+
+static int nl_uring_arm(nl_uring_t *nu)
+{
+    if (uring_recvmsg_multishot(nu->nl_sock->sock, &nu->msg, nu->bufs,
+                &nu->req))
+    {
+        return -1;
+    }
+
+    nu->armed = 1;
+    return 0;
+}
+
+static void nl_uring_datagram(nl_uring_t *nu, struct io_uring_recvmsg_out *out)
+{
+    nl_sock_t *nl_sock = nu->nl_sock;
+    struct msghdr hdr = { 0 };
+    char *name = (char *)(out + 1);
+    char *payload = name + nu->msg.msg_namelen + nu->msg.msg_controllen;
+    int nsid = NL_NSID_NONE;
+
+    nl_sock->rx_msgs++;
+
+    if (out->flags & MSG_TRUNC)
+    {
+        nlevtd_log(LOG_WARNING, "Netlink socket %d: truncated %u bytes "
+                "datagram\n", nl_sock->sock, out->payloadlen);
+
+        nl_sock->rx_truncated++;
+        nu->lost = 1;
+        return;
+    }
+
+    if (out->namelen != sizeof(struct sockaddr_nl) || !out->payloadlen)
+        return;
+
+    if (nl_sock->ctrls)
+    {
+        hdr.msg_control = name + nu->msg.msg_namelen;
+        hdr.msg_controllen = out->controllen;
+        nsid = nl_msg_nsid(&hdr);
+    }
+
+    /* provided buffers have a spare byte past the payload */
+    nl_sock->recv(nl_sock, payload, out->payloadlen, nsid);
+}
+
+static void on_nl_uring_complete(uring_req_t *req, int res, unsigned int flags)
+{
+    nl_uring_t *nu = (nl_uring_t *)req;
+    unsigned int bid;
+
+    if (nu->removed)
+    {
+        if (flags & IORING_CQE_F_BUFFER)
+            uring_bufs_put(nu->bufs, flags >> IORING_CQE_BUFFER_SHIFT);
+
+        if (!(flags & IORING_CQE_F_MORE))
+        {
+            nu->armed = 0;
+            uring_defer(&nu->req);
+        }
+
+        return;
+    }
+
+    if (nu->pass != uring_pass)
+    {
+        nu->pass = uring_pass;
+        nu->pass_bufs = 0;
+        nu->nl_sock->rx_wakeups++;
+    }
+
+    /* the receive stopped, the rest is drained once the pass is done */
+    if (!(flags & IORING_CQE_F_MORE))
+    {
+        nu->armed = 0;
+        uring_defer(&nu->req);
+    }
+
+    if (res < 0)
+    {
+        /* not all the buffers were used, so the kernel dropped messages */
+        if (res == -ENOBUFS && nu->pass_bufs < nu->bufs->entries)
+        {
+            nu->nl_sock->rx_overruns++;
+            nu->lost = 1;
+        }
+        else if (res != -ENOBUFS)
+        {
+            nlevtd_log(LOG_ERR, "Netlink socket %d: io_uring recvmsg: %s\n",
+                    nu->nl_sock->sock, strerror(-res));
+        }
+
+        if (nu->lost)
+            uring_defer(&nu->req);
+
+        return;
+    }
+
+    if (!(flags & IORING_CQE_F_BUFFER))
+        return;
+
+    bid = flags >> IORING_CQE_BUFFER_SHIFT;
+    nu->pass_bufs++;
+
+    nl_uring_datagram(nu, (struct io_uring_recvmsg_out *)
+            uring_bufs_get(nu->bufs, bid));
+
+    uring_bufs_put(nu->bufs, bid);
+
+    if (nu->lost && !nu->removed)
+        uring_defer(&nu->req);
+}
+
+static void on_nl_sock_poll(int sock, void *arg)
+{
+    nl_sock_recv((nl_sock_t *)arg);
+}
+
+static void on_drain_lost(nl_sock_t *nl_sock)
+{
+    drain_lost = 1;
+}
+
+static void on_nl_uring_deferred(uring_req_t *req)
+{
+    nl_uring_t *nu = (nl_uring_t *)req;
+    nl_sock_t *nl_sock = nu->nl_sock;
+
+    if (!nu->armed && !nu->removed)
+    {
+        drain_lost = 0;
+        nl_sock_drain(nl_sock, nl_sock->recv, on_drain_lost);
+
+        if (drain_lost)
+            nu->lost = 1;
+    }
+
+    /* the loss is reported after the queued datagrams */
+    if (nu->lost && !nu->removed)
+    {
+        nu->lost = 0;
+
+        nlevtd_log(LOG_WARNING, "Netlink socket %d: events were lost\n",
+                nl_sock->sock);
+
+        if (nl_sock->lost)
+            nl_sock->lost(nl_sock);
+    }
+
+    /* destroyed by the callbacks or before */
+    if (nu->removed)
+    {
+        if (!nu->armed)
+            nl_uring_free(nu);
+
+        return;
+    }
+
+    if (!nu->armed && nl_uring_arm(nu))
+    {
+        nlevtd_log(LOG_ERR, "Netlink socket %d: can't post io_uring receive, "
+                "using poll\n", nl_sock->sock);
+
+        poll_register_handler_flags(nl_sock->sock, POLL_EDGE,
+                on_nl_sock_poll, nl_sock);
+        nu->polling = 1;
+    }
+}
+
+int nl_uring_register(nl_sock_t *nl_sock)
+{
+    nl_uring_t *nu;
+
+    nu = (nl_uring_t *)malloc(sizeof(nl_uring_t));
+    memset(nu, 0, sizeof(nl_uring_t));
+
+    if (!(nu->bufs = uring_bufs_create(NL_URING_BUFS, NL_URING_BUF_SIZE)))
+    {
+        free(nu);
+        return -1;
+    }
+
+    nu->nl_sock = nl_sock;
+    nu->req.complete = on_nl_uring_complete;
+    nu->req.deferred = on_nl_uring_deferred;
+    /* the kernel only reads the name and control lengths */
+    nu->msg.msg_namelen = sizeof(struct sockaddr_nl);
+    nu->msg.msg_controllen = nl_sock->ctrls ? NL_CTRL_SIZE : 0;
+
+    if (nl_uring_arm(nu))
+    {
+        uring_bufs_free(nu->bufs);
+        free(nu);
+        return -1;
+    }
+
+    nu->next = nl_urings;
+    nl_urings = nu;
+
+    return 0;
+}
+
+/*
+ * The pending receive is cancelled, nl_uring_t is freed with its last
+ * completion, the socket itself is not touched after this call.
+ */
+void nl_uring_unregister(nl_sock_t *nl_sock)
+{
+    nl_uring_t *nu;
+
+    for (nu = nl_urings; nu && nu->nl_sock != nl_sock; nu = nu->next)
+        ;
+
+    if (!nu || nu->removed)
+        return;
+
+    nu->removed = 1;
+
+    if (nu->polling)
+    {
+        poll_unregister_handler(nl_sock->sock);
+        nl_uring_free(nu);
+    }
+    else if (nu->armed)
+    {
+        uring_cancel(&nu->req);
+    }
+}
+
+/* should be called before the ring is closed */
+void nl_uring_cleanup(void)
+{
+    nl_uring_t *next;
+
+    while (nl_urings)
+    {
+        next = nl_urings->next;
+        uring_bufs_free(nl_urings->bufs);
+        free(nl_urings);
+        nl_urings = next;
+    }
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2013 Vadim Kochan <vadim4j@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _NL_URING_H_
+#define _NL_URING_H_
+
+#include "netlink.h"
+
+/* provided buffers per socket, should be a power of 2 */
+#define NL_URING_BUFS 32
+
+/* size of each provided buffer */
+#define NL_URING_BUF_SIZE (32 * 1024)
+
+int nl_uring_register(nl_sock_t *nl_sock);
+void nl_uring_unregister(nl_sock_t *nl_sock);
+void nl_uring_cleanup(void);
+
+#endif /* _NL_URING_H_ */
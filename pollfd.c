@@ -16,57 +16,603 @@
  */
 
 #include <stdlib.h>
-#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
 #include <errno.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
 
-#define SECS 1000
+#include "pollfd.h"
+#include "uring.h"
+#include "log.h"
+
+/* max number of the ready fds handled per epoll_wait() call */
+#define POLL_EVENTS_MAX 32
+
+/*
+ * Timer wheel levels, each next level slot covers the whole lower level, so
+ * the timers up to 2^24 ticks (about 46 hours) away are kept.
+ */
+#define POLL_WHEEL_BITS 6
+#define POLL_WHEEL_SLOTS (1 << POLL_WHEEL_BITS)
+#define POLL_WHEEL_MASK (POLL_WHEEL_SLOTS - 1)
+#define POLL_WHEEL_LEVELS 4
+#define POLL_WHEEL_MAX ((1ul << (POLL_WHEEL_BITS * POLL_WHEEL_LEVELS)) - 1)
 
 typedef struct poll_handler
 {
+    /* io_uring poll request, should be the first */
+    uring_req_t req;
     int fd;
+    int flags;
     void *arg;
     void (* func)(int fd, void *arg);
+    /* io_uring state: poll request is pending, the handler is running or
+     * was unregistered and waits for the pending request to complete */
+    int armed;
+    int in_cb;
+    int removed;
     struct poll_handler *next;
 } poll_handler_t;
 
+/* object to be freed once the current events are handled */
+typedef struct poll_release
+{
+    void (* func)(void *arg);
+    void *arg;
+    struct poll_release *next;
+} poll_release_t;
+
+typedef struct poll_signal
+{
+    void (* func)(int signo, void *arg);
+    void *arg;
+} poll_signal_t;
+
+int poll_uring = 0;
+
 static poll_handler_t *handlers = NULL;
-static int poll_count = 0;
-static struct pollfd *poll_list = NULL;
+static int poll_fd = -1;
+static int poll_uring_ready = 0;
 
-void poll_register_handler(int fd, void (*func)(int fd, void *arg), void *arg)
+static poll_release_t *releases = NULL;
+static poll_signal_t signals[_NSIG];
+static sigset_t signal_mask;
+static int signal_fd = -1;
+
+static poll_timer_t *wheel[POLL_WHEEL_LEVELS][POLL_WHEEL_SLOTS];
+/* next tick to run, all the earlier timers have been run */
+static unsigned long wheel_tick;
+static unsigned int wheel_count = 0;
+static int wheel_running = 0;
+static unsigned long timer_armed;
+static int timer_is_armed = 0;
+static int timer_fd = -1;
+
+static int poll_fd_get(void)
+{
+    if (poll_fd < 0 && (poll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+    {
+        return nlevtd_log(LOG_ERR, "Can't create epoll: %s\n",
+                strerror(errno));
+    }
+
+    return poll_fd;
+}
+
+/* io_uring is set up on the first use, epoll is used if it is not supported */
+static int poll_setup(void)
+{
+    if (poll_uring && !poll_uring_ready)
+    {
+        if (uring_init(URING_ENTRIES))
+        {
+            nlevtd_log(LOG_WARNING, "io_uring is not available, using epoll\n");
+            poll_uring = 0;
+        }
+        else
+        {
+            poll_uring_ready = 1;
+        }
+    }
+
+    if (poll_uring)
+        return 0;
+
+    return poll_fd_get() < 0 ? -1 : 0;
+}
+
+int poll_uring_active(void)
+{
+    poll_setup();
+
+    return poll_uring;
+}
+
+/*
+ * Calls func(arg) after all the handlers of the ready fds have returned, so
+ * the objects which the handlers may still refer to can be freed from them.
+ */
+void poll_release(void (*func)(void *arg), void *arg)
+{
+    poll_release_t *rel = (poll_release_t *)malloc(sizeof(poll_release_t));
+
+    rel->func = func;
+    rel->arg = arg;
+    rel->next = releases;
+    releases = rel;
+}
+
+static void poll_releases_run(void)
+{
+    poll_release_t *rel;
+
+    while ((rel = releases))
+    {
+        releases = rel->next;
+        rel->func(rel->arg);
+        free(rel);
+    }
+}
+
+static void poll_handler_unlink(poll_handler_t *h)
+{
+    poll_handler_t **it;
+
+    for (it = &handlers; *it; it = &(*it)->next)
+    {
+        if (*it == h)
+        {
+            *it = h->next;
+            break;
+        }
+    }
+}
+
+static void poll_handler_free(poll_handler_t *h)
+{
+    poll_handler_unlink(h);
+    free(h);
+}
+
+static int poll_handler_arm(poll_handler_t *h)
+{
+    /* level semantics are kept by one-shot polls armed after each call */
+    if (uring_poll(h->fd, h->flags & POLL_EDGE, &h->req))
+        return -1;
+
+    h->armed = 1;
+    return 0;
+}
+
+static void on_poll_complete(uring_req_t *req, int res, unsigned int flags)
+{
+    poll_handler_t *h = (poll_handler_t *)req;
+
+    if (!(flags & IORING_CQE_F_MORE))
+        h->armed = 0;
+
+    if (res > 0 && !h->removed)
+    {
+        h->in_cb = 1;
+        h->func(h->fd, h->arg);
+        h->in_cb = 0;
+    }
+
+    if (h->removed)
+    {
+        if (!h->armed)
+            poll_handler_free(h);
+
+        return;
+    }
+
+    if (res < 0)
+    {
+        nlevtd_log(LOG_ERR, "Can't poll fd %d: %s\n", h->fd, strerror(-res));
+        return;
+    }
+
+    if (!h->armed)
+        poll_handler_arm(h);
+}
+
+/*
+ * The handler goes as epoll data (or io_uring user data), so the ready fd is
+ * dispatched without any lookup. With POLL_EDGE the handler is called only when new data arrives,
+ * so it should read the fd until EAGAIN.
+ */
+int poll_register_handler_flags(int fd, int flags,
+    void (*func)(int fd, void *arg), void *arg)
 {
-    poll_handler_t *new_handler = (poll_handler_t *)malloc(sizeof(poll_handler_t));
+    poll_handler_t *new_handler;
+    struct epoll_event event = { .events = EPOLLIN };
+
+    if (poll_setup())
+        return -1;
 
+    new_handler = (poll_handler_t *)malloc(sizeof(poll_handler_t));
+    memset(new_handler, 0, sizeof(poll_handler_t));
     new_handler->fd = fd;
+    new_handler->flags = flags;
     new_handler->arg = arg;
     new_handler->func = func;
+
+    if (poll_uring)
+    {
+        new_handler->req.complete = on_poll_complete;
+
+        if (poll_handler_arm(new_handler))
+        {
+            free(new_handler);
+            return nlevtd_log(LOG_ERR, "Can't poll fd %d\n", fd);
+        }
+
+        new_handler->next = handlers;
+        handlers = new_handler;
+
+        return 0;
+    }
+
+    if (flags & POLL_EDGE)
+        event.events |= EPOLLET;
+
+    event.data.ptr = new_handler;
+
+    if (epoll_ctl(poll_fd, EPOLL_CTL_ADD, fd, &event))
+    {
+        free(new_handler);
+        return nlevtd_log(LOG_ERR, "Can't add fd %d to epoll: %s\n", fd,
+                strerror(errno));
+    }
+
     new_handler->next = handlers;
     handlers = new_handler;
-    poll_count++;
+
+    return 0;
 }
 
-int poll_init(void)
+void poll_register_handler(int fd, void (*func)(int fd, void *arg), void *arg)
+{
+    poll_register_handler_flags(fd, 0, func, arg);
+}
+
+/*
+ * May be called from any handler, the own one too, fd should stay open until
+ * this call. With io_uring the handler is freed once the pending poll is
+ * cancelled.
+ */
+void poll_unregister_handler(int fd)
 {
-    int i = 0;
-    poll_handler_t *h = handlers;
+    poll_handler_t *h;
+
+    for (h = handlers; h; h = h->next)
+    {
+        if (h->fd == fd && !h->removed)
+            break;
+    }
+
+    if (!h)
+        return;
+
+    h->removed = 1;
+
+    /* the handler may be among the ready ones which are not handled yet */
+    if (!poll_uring)
+    {
+        epoll_ctl(poll_fd, EPOLL_CTL_DEL, fd, NULL);
+        poll_handler_unlink(h);
+        poll_release(free, h);
+        return;
+    }
 
-    poll_list = (struct pollfd *)malloc(poll_count * sizeof(struct pollfd));
+    if (h->armed)
+        uring_cancel(&h->req);
+    else if (!h->in_cb)
+        poll_handler_free(h);
+}
+
+static void on_signal_poll(int fd, void *arg)
+{
+    struct signalfd_siginfo info;
+    poll_signal_t *sig;
 
-    while (h)
+    while (read(fd, &info, sizeof(info)) == sizeof(info))
     {
-        poll_list[i].fd = h->fd;
-        poll_list[i].events = POLLIN;
-        h = h->next;
-	i++;
+        if (info.ssi_signo >= _NSIG)
+            continue;
+
+        sig = &signals[info.ssi_signo];
+
+        if (sig->func)
+            sig->func(info.ssi_signo, sig->arg);
+    }
+}
+
+/*
+ * The signal is blocked and comes as the signalfd event, so its handler runs
+ * in the main loop as any other one and may do anything.
+ */
+int poll_register_signal(int signo, void (*func)(int signo, void *arg),
+    void *arg)
+{
+    int fd;
+
+    if (signal_fd < 0)
+        sigemptyset(&signal_mask);
+
+    sigaddset(&signal_mask, signo);
+    sigprocmask(SIG_BLOCK, &signal_mask, NULL);
+
+    signals[signo].func = func;
+    signals[signo].arg = arg;
+
+    if ((fd = signalfd(signal_fd, &signal_mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0)
+        return nlevtd_log(LOG_ERR, "Can't create signalfd: %s\n",
+                strerror(errno));
+
+    if (signal_fd < 0)
+    {
+        signal_fd = fd;
+
+        if (poll_register_handler_flags(signal_fd, 0, on_signal_poll, NULL))
+            return -1;
     }
 
     return 0;
 }
 
+static unsigned long poll_ticks_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * (1000 / POLL_TIMER_TICK) +
+        ts.tv_nsec / (POLL_TIMER_TICK * 1000000);
+}
+
+static void poll_timer_unlink(poll_timer_t *timer)
+{
+    if (timer->next)
+        timer->next->pprev = timer->pprev;
+
+    *timer->pprev = timer->next;
+    timer->pprev = NULL;
+    timer->next = NULL;
+}
+
+static void poll_timer_link(poll_timer_t *timer)
+{
+    unsigned long delta;
+    poll_timer_t **slot;
+    int level;
+
+    /* already expired ones are run on the next tick */
+    if ((long)(timer->expires - wheel_tick) < 0)
+        timer->expires = wheel_tick;
+
+    if ((delta = timer->expires - wheel_tick) > POLL_WHEEL_MAX)
+    {
+        delta = POLL_WHEEL_MAX;
+        timer->expires = wheel_tick + delta;
+    }
+
+    for (level = 0; level < POLL_WHEEL_LEVELS - 1; level++)
+    {
+        if (delta < 1ul << (POLL_WHEEL_BITS * (level + 1)))
+            break;
+    }
+
+    slot = &wheel[level][(timer->expires >> (POLL_WHEEL_BITS * level)) &
+        POLL_WHEEL_MASK];
+
+    timer->next = *slot;
+    timer->pprev = slot;
+
+    if (*slot)
+        (*slot)->pprev = &timer->next;
+
+    *slot = timer;
+}
+
+/* moves the slot list to head, so the timers may be unlinked from it */
+static poll_timer_t *poll_timer_slot_take(poll_timer_t **slot,
+    poll_timer_t **head)
+{
+    if ((*head = *slot))
+        (*head)->pprev = head;
+
+    *slot = NULL;
+    return *head;
+}
+
+static void poll_timers_cascade(int level, int idx)
+{
+    poll_timer_t *head, *timer;
+
+    poll_timer_slot_take(&wheel[level][idx], &head);
+
+    while ((timer = head))
+    {
+        poll_timer_unlink(timer);
+        poll_timer_link(timer);
+    }
+}
+
+static void poll_timers_run(unsigned long now)
+{
+    poll_timer_t *head, *timer;
+    int level, idx;
+
+    wheel_running = 1;
+
+    while ((long)(now - wheel_tick) >= 0)
+    {
+        /* each wrap of a level brings down the next slot of the upper one */
+        for (level = 1; level < POLL_WHEEL_LEVELS; level++)
+        {
+            if ((wheel_tick >> (POLL_WHEEL_BITS * (level - 1))) &
+                    POLL_WHEEL_MASK)
+            {
+                break;
+            }
+
+            poll_timers_cascade(level, (wheel_tick >>
+                        (POLL_WHEEL_BITS * level)) & POLL_WHEEL_MASK);
+        }
+
+        idx = wheel_tick & POLL_WHEEL_MASK;
+        wheel_tick++;
+
+        /* the handler may add and delete any timers, itself too */
+        poll_timer_slot_take(&wheel[0][idx], &head);
+
+        while ((timer = head))
+        {
+            poll_timer_unlink(timer);
+            wheel_count--;
+
+            timer->func(timer, timer->arg);
+        }
+    }
+
+    wheel_running = 0;
+}
+
+/*
+ * timerfd is armed for the nearest lower level timer or for the next
+ * cascade, so the far timers cost a wakeup per the lower level wrap at most.
+ */
+static void poll_timers_arm(void)
+{
+    struct itimerspec its;
+    unsigned long next;
+    int i;
+
+    memset(&its, 0, sizeof(its));
+
+    if (wheel_count)
+    {
+        /* the cascade of the current tick is pending too if it is aligned */
+        next = (wheel_tick + POLL_WHEEL_MASK) & ~(unsigned long)POLL_WHEEL_MASK;
+
+        for (i = 0; wheel_tick + i < next; i++)
+        {
+            if (wheel[0][(wheel_tick + i) & POLL_WHEEL_MASK])
+                break;
+        }
+
+        next = wheel_tick + i;
+
+        if (timer_is_armed && timer_armed == next)
+            return;
+
+        its.it_value.tv_sec = next / (1000 / POLL_TIMER_TICK);
+        its.it_value.tv_nsec = (next % (1000 / POLL_TIMER_TICK)) *
+            POLL_TIMER_TICK * 1000000;
+
+        timer_armed = next;
+    }
+    else if (!timer_is_armed)
+    {
+        return;
+    }
+
+    timer_is_armed = wheel_count != 0;
+
+    if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL))
+        nlevtd_log(LOG_ERR, "Can't set timerfd: %s\n", strerror(errno));
+}
+
+static void on_timer_poll(int fd, void *arg)
+{
+    unsigned long long count;
+
+    if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        return;
+
+    timer_is_armed = 0;
+
+    poll_timers_run(poll_ticks_now());
+    poll_timers_arm();
+}
+
+void poll_timer_init(poll_timer_t *timer,
+    void (*func)(poll_timer_t *timer, void *arg), void *arg)
+{
+    memset(timer, 0, sizeof(*timer));
+    timer->func = func;
+    timer->arg = arg;
+}
+
+int poll_timer_pending(poll_timer_t *timer)
+{
+    return timer->pprev != NULL;
+}
+
+/* (re)schedules the timer to run once after msecs */
+int poll_timer_add(poll_timer_t *timer, unsigned int msecs)
+{
+    unsigned long now = poll_ticks_now();
+
+    if (timer_fd < 0)
+    {
+        timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+        if (timer_fd < 0)
+        {
+            return nlevtd_log(LOG_ERR, "Can't create timerfd: %s\n",
+                    strerror(errno));
+        }
+
+        if (poll_register_handler_flags(timer_fd, 0, on_timer_poll, NULL))
+            return -1;
+    }
+
+    poll_timer_del(timer);
+
+    /* nothing to run in between, the wheel may skip the idle time */
+    if (!wheel_count && !wheel_running)
+        wheel_tick = now;
+
+    timer->expires = now + (msecs + POLL_TIMER_TICK - 1) / POLL_TIMER_TICK;
+    poll_timer_link(timer);
+    wheel_count++;
+
+    if (!wheel_running)
+        poll_timers_arm();
+
+    return 0;
+}
+
+void poll_timer_del(poll_timer_t *timer)
+{
+    if (!poll_timer_pending(timer))
+        return;
+
+    poll_timer_unlink(timer);
+    wheel_count--;
+
+    if (!wheel_running)
+        poll_timers_arm();
+}
+
+/* handlers, signals and timers may be registered before and after poll_init */
+int poll_init(void)
+{
+    return poll_setup();
+}
+
 void poll_cleanup(void)
 {
     poll_handler_t *next;
 
+    poll_releases_run();
+
     while (handlers)
     {
         next = handlers->next;
@@ -74,35 +620,64 @@ void poll_cleanup(void)
         handlers = next;
     }
 
-    if (poll_list)
-        free(poll_list);
+    if (poll_fd >= 0)
+        close(poll_fd);
+
+    poll_fd = -1;
+
+    if (signal_fd >= 0)
+        close(signal_fd);
+
+    if (timer_fd >= 0)
+        close(timer_fd);
+
+    signal_fd = timer_fd = -1;
+    timer_is_armed = 0;
+    wheel_count = 0;
+    memset(wheel, 0, sizeof(wheel));
+
+    /* the pending requests go away with the ring */
+    if (poll_uring_ready)
+        uring_cleanup();
+
+    poll_uring_ready = 0;
 }
 
 int poll_events(void)
 {
-    int i;
+    struct epoll_event events[POLL_EVENTS_MAX];
+    poll_handler_t *h;
+    int i, count;
 
-    if (poll(poll_list, poll_count, 10 * SECS) < 0)
-        return 0;
+    if (poll_uring)
+    {
+        if (uring_wait())
+            return -1;
 
-    if (errno == EINTR)
+        poll_releases_run();
         return 0;
+    }
 
-    for (i = 0; i < poll_count; i++)
+    /* no timeout, nothing is done until some fd is ready */
+    count = epoll_wait(poll_fd, events, POLL_EVENTS_MAX, -1);
+
+    if (count < 0)
     {
-        poll_handler_t *h = handlers;
+        if (errno == EINTR)
+            return 0;
 
-        if (!(poll_list[i].revents & POLLIN))
-	    continue;
+        return nlevtd_log(LOG_ERR, "epoll_wait(): %s\n", strerror(errno));
+    }
 
-        while (h)
-        {
-            if (h->fd == poll_list[i].fd)
-                h->func(poll_list[i].fd, h->arg);
+    for (i = 0; i < count; i++)
+    {
+        h = (poll_handler_t *)events[i].data.ptr;
 
-	    h = h->next;
-        }
+        if (!h->removed)
+            h->func(h->fd, h->arg);
     }
 
+    poll_releases_run();
+
     return 0;
 }
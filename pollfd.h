@@ -18,7 +18,38 @@
 #ifndef _POLLFD_H_
 #define _POLLFD_H_
 
+/* the handler is called only on new data, the fd should be fully drained */
+#define POLL_EDGE 1
+
+/* timers resolution, in msecs */
+#define POLL_TIMER_TICK 10
+
+/* use io_uring instead of epoll if the kernel supports it */
+extern int poll_uring;
+
+/* one-shot timer, allocated by the user and kept in the timer wheel */
+typedef struct poll_timer
+{
+    struct poll_timer *next;
+    struct poll_timer **pprev;
+    unsigned long expires;
+    void (* func)(struct poll_timer *timer, void *arg);
+    void *arg;
+} poll_timer_t;
+
 void poll_register_handler(int fd, void (*func)(int fd, void *arg), void *arg);
+int poll_register_handler_flags(int fd, int flags,
+    void (*func)(int fd, void *arg), void *arg);
+void poll_unregister_handler(int fd);
+void poll_release(void (*func)(void *arg), void *arg);
+int poll_uring_active(void);
+int poll_register_signal(int signo, void (*func)(int signo, void *arg),
+    void *arg);
+void poll_timer_init(poll_timer_t *timer,
+    void (*func)(poll_timer_t *timer, void *arg), void *arg);
+int poll_timer_add(poll_timer_t *timer, unsigned int msecs);
+void poll_timer_del(poll_timer_t *timer);
+int poll_timer_pending(poll_timer_t *timer);
 int poll_init(void);
 void poll_cleanup(void);
 int poll_events(void);
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2013 Vadim Kochan <vadim4j@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ring.h"
+
+/* record is a length word followed by the payload, aligned to 8 bytes */
+#define REC_ALIGN 8
+#define REC_HDR REC_ALIGN
+#define REC_WRAP 0xffffffff
+
+#define rec_size(len) (((len) + REC_HDR + REC_ALIGN - 1) & ~(REC_ALIGN - 1))
+
+int ring_init(ring_t *ring, unsigned int size)
+{
+    unsigned int real_size = 4096;
+
+    while (real_size < size)
+        real_size <<= 1;
+
+    memset(ring, 0, sizeof(*ring));
+
+    if (!(ring->buf = (unsigned char *)malloc(real_size)))
+        return -1;
+
+    ring->size = real_size;
+    return 0;
+}
+
+void ring_free(ring_t *ring)
+{
+    free(ring->buf);
+    ring->buf = NULL;
+}
+
+/* producer: copies the record or drops it if there is no room */
+int ring_put(ring_t *ring, void *hdr, unsigned int hdr_len, void *data,
+    unsigned int data_len)
+{
+    unsigned int head = atomic_load_explicit(&ring->head,
+            memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&ring->tail,
+            memory_order_acquire);
+    unsigned int len = hdr_len + data_len;
+    unsigned int pos = head & (ring->size - 1);
+    unsigned int to_end = ring->size - pos;
+    unsigned int need = rec_size(len);
+    unsigned char *rec;
+
+    /* record is never split, the tail of the buffer is skipped instead */
+    if (need > to_end)
+        need += to_end;
+
+    if (ring->size - (head - tail) < need)
+    {
+        ring->drops++;
+        return -1;
+    }
+
+    if (rec_size(len) > to_end)
+    {
+        *(unsigned int *)&ring->buf[pos] = REC_WRAP;
+        pos = 0;
+    }
+
+    rec = &ring->buf[pos];
+    *(unsigned int *)rec = len;
+    memcpy(rec + REC_HDR, hdr, hdr_len);
+    memcpy(rec + REC_HDR + hdr_len, data, data_len);
+
+    head += need;
+    atomic_store_explicit(&ring->head, head, memory_order_release);
+
+    ring->puts++;
+
+    if (head - tail > ring->max_used)
+        ring->max_used = head - tail;
+
+    return 0;
+}
+
+/* consumer: returns the oldest record or NULL if the ring is empty */
+void *ring_get(ring_t *ring, unsigned int *len)
+{
+    unsigned int tail = atomic_load_explicit(&ring->tail,
+            memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&ring->head,
+            memory_order_acquire);
+    unsigned int pos;
+
+    if (tail == head)
+        return NULL;
+
+    pos = tail & (ring->size - 1);
+
+    if (*(unsigned int *)&ring->buf[pos] == REC_WRAP)
+    {
+        tail += ring->size - pos;
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+
+        if (tail == head)
+            return NULL;
+
+        pos = 0;
+    }
+
+    *len = *(unsigned int *)&ring->buf[pos];
+    return &ring->buf[pos + REC_HDR];
+}
+
+/* consumer: releases the record returned by ring_get() */
+void ring_consume(ring_t *ring, unsigned int len)
+{
+    unsigned int tail = atomic_load_explicit(&ring->tail,
+            memory_order_relaxed);
+
+    atomic_store_explicit(&ring->tail, tail + rec_size(len),
+            memory_order_release);
+}
+
+unsigned int ring_used(ring_t *ring)
+{
+    return atomic_load_explicit(&ring->head, memory_order_acquire) -
+        atomic_load_explicit(&ring->tail, memory_order_acquire);
+}
+
+/* producer position, the records put before it end there */
+unsigned int ring_produced(ring_t *ring)
+{
+    return atomic_load_explicit(&ring->head, memory_order_acquire);
+}
+
+/* consumer: checks if all the records up to the position are consumed */
+int ring_consumed(ring_t *ring, unsigned int pos)
+{
+    return (int)(atomic_load_explicit(&ring->tail, memory_order_relaxed) -
+            pos) >= 0;
+}
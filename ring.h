@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2013 Vadim Kochan <vadim4j@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _RING_H_
+#define _RING_H_
+
+#include <stdatomic.h>
+
+/*
+ * Lock-free single-producer single-consumer ring of variable size records.
+ * Positions are free running counters, the size is a power of 2.
+ */
+typedef struct ring
+{
+    unsigned char *buf;
+    unsigned int size;
+    _Atomic unsigned int head;
+    _Atomic unsigned int tail;
+
+    /* producer side statistics */
+    unsigned long puts;
+    unsigned long drops;
+    unsigned int max_used;
+} ring_t;
+
+int ring_init(ring_t *ring, unsigned int size);
+void ring_free(ring_t *ring);
+int ring_put(ring_t *ring, void *hdr, unsigned int hdr_len, void *data,
+    unsigned int data_len);
+void *ring_get(ring_t *ring, unsigned int *len);
+void ring_consume(ring_t *ring, unsigned int len);
+unsigned int ring_used(ring_t *ring);
+unsigned int ring_produced(ring_t *ring);
+int ring_consumed(ring_t *ring, unsigned int pos);
+
+#endif /* _RING_H_ */
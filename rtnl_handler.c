@@ -16,55 +16,302 @@
  */
 
 #include <stdio.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sys/stat.h>
 #include <sys/socket.h>
 #include <linux/netlink.h>
 #include <linux/rtnetlink.h>
 #include <net/if.h>
+#include <linux/if.h>
 #include <net/ethernet.h>
 #include <net/if_arp.h>
 #include <netinet/ether.h>
+#include <arpa/inet.h>
 
 #include "defs.h"
+#include "bpf.h"
 #include "nl_handler.h"
+#include "rtnl_state.h"
+#include "rtnl_summary.h"
+#include "netns.h"
+#include "fsnotify.h"
+#include "pollfd.h"
+#include "event.h"
 #include "utils.h"
+#include "log.h"
 
 #ifndef NDA_RTA
     #define NDA_RTA(r)\
        ((struct rtattr*)(((char*)(r)) + NLMSG_ALIGN(sizeof(struct ndmsg))))
 #endif
 
-#define ADDR_MAX 256
-#define NUMB_MAX 10
-
-char nl_qdisc[40] = {};
-char nl_mtu[NUMB_MAX] = {};
-char nl_broadcast[ADDR_MAX] = {};
-char nl_address[ADDR_MAX] = {};
-char nl_local[ADDR_MAX] = {};
-char nl_anycast[ADDR_MAX] = {};
-char nl_label[IFNAMSIZ] = {};
-char nl_if[IFNAMSIZ] = {};
-char nl_prefixlen[NUMB_MAX] = {};
-char nl_lladdr[ADDR_MAX] = {};
-char nl_dst_len[NUMB_MAX] = {};
-char nl_src_len[NUMB_MAX] = {};
-char nl_tos[NUMB_MAX] = {};
-char nl_dst[ADDR_MAX] = {};
-char nl_src[ADDR_MAX] = {};
-char nl_gateway[ADDR_MAX] = {};
-char nl_prio[NUMB_MAX] = {};
-char nl_metrics[NUMB_MAX] = {};
-char nl_iif[IFNAMSIZ] = {};
-char nl_oif[IFNAMSIZ] = {};
-
-static key_value_t *kv_addr = NULL;
-static key_value_t *kv_link = NULL;
-static key_value_t *kv_neigh = NULL;
-static key_value_t *kv_route = NULL;
-
-static nl_sock_t *rtnl_sock = NULL;
+#ifndef NDA_PAYLOAD
+    #define NDA_PAYLOAD(n) NLMSG_PAYLOAD(n, sizeof(struct ndmsg))
+#endif
+
+/* longest hardware address, MAX_ADDR_LEN of the kernel */
+#define RTNL_ADDR_MAX 32
+
+/* hardware or protocol address as it comes in the attribute */
+typedef struct rtnl_addr
+{
+    unsigned char len;
+    unsigned char data[RTNL_ADDR_MAX];
+} rtnl_addr_t;
+
+/* optional u32 attributes which are present in the message */
+#define RTNL_HAS_MTU        (1 << 0)
+#define RTNL_HAS_PRIO       (1 << 1)
+#define RTNL_HAS_METRICS    (1 << 2)
+#define RTNL_HAS_IIF        (1 << 3)
+#define RTNL_HAS_OIF        (1 << 4)
+#define RTNL_HAS_MASTER     (1 << 5)
+#define RTNL_HAS_STATS      (1 << 6)
+#define RTNL_HAS_CACHEINFO  (1 << 7)
+#define RTNL_HAS_VLAN       (1 << 8)
+
+/* nexthops of a multipath route, the rest of them are not rendered */
+#define RTNL_NEXTHOPS_MAX 8
+
+typedef struct rtnl_nexthops
+{
+    int count;
+    struct
+    {
+        int ifindex;
+        rtnl_addr_t gateway;
+    } hop[RTNL_NEXTHOPS_MAX];
+} rtnl_nexthops_t;
+
+/*
+ * Typed record of the object filled straight from the message, the values
+ * are rendered to the strings only when a rule or a program needs them.
+ */
+typedef struct rtnl_event
+{
+    /* attributes of the message which are decoded on demand */
+    int type;
+    struct rtattr *rta;
+    int rta_len;
+    int rta_max;
+    unsigned int decoded;
+    /* fields of the object, compared as a whole */
+    int ns;
+    int ifindex;
+    unsigned int flags;
+    unsigned int state;
+    unsigned int has;
+    unsigned int mtu;
+    unsigned int prio;
+    unsigned int metrics;
+    int iif;
+    int oif;
+    int master;
+    unsigned int table;
+    unsigned short hw_type;
+    unsigned short vlan;
+    unsigned char family;
+    unsigned char scope;
+    unsigned char prefixlen;
+    unsigned char dst_len;
+    unsigned char src_len;
+    unsigned char tos;
+    unsigned char operstate;
+    unsigned char proto;
+    unsigned char rt_type;
+    rtnl_addr_t address;
+    rtnl_addr_t local;
+    rtnl_addr_t broadcast;
+    rtnl_addr_t anycast;
+    rtnl_addr_t dst;
+    rtnl_addr_t src;
+    rtnl_addr_t gateway;
+    rtnl_addr_t lladdr;
+    char ifname[IFNAMSIZ];
+    char qdisc[IFNAMSIZ];
+    char label[IFNAMSIZ];
+    char kind[IFNAMSIZ];
+    rtnl_nexthops_t nexthops;
+    struct rtnl_link_stats64 stats;
+    struct ifa_cacheinfo cacheinfo;
+} rtnl_event_t;
+
+enum
+{
+    RTNL_F_ENUM,    /* u8 value rendered by its name */
+    RTNL_F_U8,
+    RTNL_F_U16,     /* optional attribute, arg is its RTNL_HAS_* bit */
+    RTNL_F_U32,     /* optional attribute, arg is its RTNL_HAS_* bit */
+    RTNL_F_U64,     /* optional attribute, arg is its RTNL_HAS_* bit */
+    RTNL_F_FLAG,    /* TRUE or FALSE, arg is the bit of the u32 value */
+    RTNL_F_INADDR,
+    RTNL_F_LLADDR,
+    RTNL_F_STR,
+    RTNL_F_NESTED,  /* string of the nested attribute, pos is its type */
+    RTNL_F_IF,      /* interface of the object */
+    RTNL_F_IFINDEX, /* optional attribute, arg is its RTNL_HAS_* bit */
+    RTNL_F_TABLE,   /* u32 attribute, the header has the table below 256 */
+    RTNL_F_NEXTHOPS,
+    RTNL_F_NETNS,
+};
+
+/*
+ * Variable of the event kind, where its value is kept in the record and the
+ * attribute it is decoded from (0 for the message header fields), pos is the
+ * offset of the value in the attribute. The variables without OLD_* pair are
+ * counters, they are not a part of the object state.
+ */
+typedef struct rtnl_field
+{
+    char *key;
+    char *old_key;
+    int type;
+    int offset;
+    unsigned int arg;
+    int attr;
+    int pos;
+    char *(*name)(int val);
+} rtnl_field_t;
+
+#define RTNL_EV(member) offsetof(rtnl_event_t, member)
+
+#define RTNL_STATS(member) .offset = RTNL_EV(stats.member), \
+    .arg = RTNL_HAS_STATS, .attr = IFLA_STATS64, \
+    .pos = offsetof(struct rtnl_link_stats64, member)
+#define RTNL_CACHEINFO(member) .offset = RTNL_EV(cacheinfo.member), \
+    .arg = RTNL_HAS_CACHEINFO, .attr = IFA_CACHEINFO, \
+    .pos = offsetof(struct ifa_cacheinfo, member)
+
+/* variable and its value in the last known state of the object */
+#define RTNL_KEY(var) .key = var, .old_key = "OLD_" var
+
+/* the largest of IFLA_MAX, IFA_MAX, NDA_MAX and RTA_MAX */
+#define RTNL_ATTRS_MAX IFLA_MAX
+
+/* kinds of the objects are indexed from RTM_NEWLINK */
+#define RTNL_KINDS 4
+#define RTNL_KIND_INDEX(type) ((RTNL_KIND(type) - RTM_NEWLINK) >> 2)
+
+/* TYPE and EVENT go before the variables of the kind and their OLD_* pairs */
+#define RTNL_VARS_MAX 64
+
+/* enough for the nexthops of a multipath route */
+#define RTNL_VAR_BUF 512
+
+/*
+ * Variable bound to the record, the rendered value is kept in buf. OLD_*
+ * variable has the value only if it differs from the one in cmp record.
+ */
+typedef struct rtnl_var
+{
+    key_value_t kv;
+    const rtnl_field_t *field;
+    unsigned int bit;
+    rtnl_event_t *ev;
+    rtnl_event_t *cmp;
+    char buf[RTNL_VAR_BUF];
+} rtnl_var_t;
+
+enum
+{
+    RTNL_NOTIFY,    /* multicast notification */
+    RTNL_SEED,      /* dumped object, update state only */
+    RTNL_SYNC,      /* dumped object, send event if it differs from state */
+    RTNL_REPLAY,    /* object restored from the state, send event only */
+    RTNL_DUMP,      /* dumped object, update state and send DUMP* event */
+};
+
+#define RTNL_KINDS_ALL (RTNL_KIND_BIT(RTM_NEWLINK) | \
+        RTNL_KIND_BIT(RTM_NEWADDR) | RTNL_KIND_BIT(RTM_NEWROUTE) | \
+        RTNL_KIND_BIT(RTM_NEWNEIGH))
+
+/*
+ * Network namespace served by its own socket, the first one is the namespace
+ * nleventd runs in. The id scopes the state objects of the namespace.
+ */
+typedef struct rtnl_ns
+{
+    struct rtnl_ns *next;
+    int id;
+    char *name;
+    int fd;
+    nl_sock_t *sock;
+} rtnl_ns_t;
+
+/* ids of the namespaces which are seen via nsid of the own namespace socket */
+#define RTNL_NS_NSID 0x10000
+
+/*
+ * Named namespaces are rescanned after the changes of their folder settle, a
+ * new file is bind mounted after it is created, so it may be not ready yet.
+ */
+#define RTNL_NETNS_SCAN_DELAY 100
+#define RTNL_NETNS_SCAN_RETRY 1000
+#define RTNL_NETNS_SCAN_RETRIES 5
+
+static rtnl_ns_t *rtnl_ns_list = NULL;
+static int rtnl_ns_count = 0;
+
+static poll_timer_t rtnl_netns_timer;
+static int rtnl_netns_retries = 0;
+
+/*
+ * Route changes are summed up by table, gateway and interface for the period
+ * since the first one, it is one event instead of each route on a reconverge.
+ */
+#define RTNL_SUMMARY_DELAY 1000
+#define RTNL_SUMMARY_EVENT "ROUTESUMMARY"
+
+static poll_timer_t rtnl_summary_timer;
+
+/* multicast groups of the objects which can be matched by the rules */
+static unsigned int rtnl_groups = 0;
+
+/* groups joined by the sockets, links are followed for the interface names */
+static unsigned int rtnl_sock_groups = 0;
+
+/* groups of the objects which events are sent, routes may be summed up only */
+static unsigned int rtnl_event_groups = 0;
+static unsigned int rtnl_summary_groups = 0;
+
+/* fields of each kind the rules look at, their attributes are decoded first */
+static unsigned int rtnl_need[RTNL_KINDS];
+
+/* fields of the routes the summary is keyed by */
+static char *rtnl_summary_keys[] = { NL_OIF, NL_GATEWAY, NL_TABLE, NULL };
+static unsigned int rtnl_summary_need;
+
+static const struct
+{
+    int kind;
+    int family;
+    unsigned int group;
+} rtnl_groups_list[] =
+{
+    { RTM_NEWLINK, AF_UNSPEC, RTMGRP_LINK },
+    { RTM_NEWADDR, AF_INET, RTMGRP_IPV4_IFADDR },
+    { RTM_NEWADDR, AF_INET6, RTMGRP_IPV6_IFADDR },
+    { RTM_NEWROUTE, AF_INET, RTMGRP_IPV4_ROUTE },
+    { RTM_NEWROUTE, AF_INET6, RTMGRP_IPV6_ROUTE },
+    { RTM_NEWNEIGH, AF_UNSPEC, RTMGRP_NEIGH },
+};
+
+static struct
+{
+    unsigned long resyncs;
+    unsigned long recovered;
+} rtnl_stats;
+
+int rtnl_rcvbuf = NL_RCVBUF_RTNL;
+int rtnl_dump_events = 0;
+int rtnl_all_nsid = 0;
+int rtnl_netns_all = 0;
 
 static void rt_attrs_parse(struct rtattr *tb_attr[], int max,
         struct rtattr *rta, int len)
@@ -107,6 +354,23 @@ static char *event_name_get(int type)
     return NULL;
 }
 
+static char *dump_name_get(int type)
+{
+    switch (RTNL_KIND(type))
+    {
+        case RTM_NEWLINK:
+            return "DUMPLINK";
+        case RTM_NEWADDR:
+            return "DUMPADDR";
+        case RTM_NEWROUTE:
+            return "DUMPROUTE";
+        case RTM_NEWNEIGH:
+            return "DUMPNEIGH";
+    }
+
+    return NULL;
+}
+
 static char *ifa_family_name_get(int ifa_family)
 {
     if (ifa_family == AF_INET)
@@ -136,159 +400,37 @@ static char *ifa_scope_name_get(int ifa_scope)
     return NL_UNSPEC;
 }
 
-static char *hw_addr_parse(char *haddr, int htype)
-{
-    if (!(htype == ARPHRD_ETHER))
-        return NL_UNSPEC;
-
-    return ether_ntoa((struct ether_addr *)haddr);
-}
-
-static key_value_t *rtnl_handle_link(struct nlmsghdr *msg)
-{
-    struct rtattr *tb_attrs[IFLA_MAX + 1];
-    struct ifinfomsg *ifi = (struct ifinfomsg *)NLMSG_DATA(msg);
-
-    if_indextoname(ifi->ifi_index, nl_if);
-
-    key_value_flag_set(kv_link, NL_IS_UP, ifi->ifi_flags, IFF_UP);
-    key_value_flag_set(kv_link, NL_IS_BROADCAST, ifi->ifi_flags,
-            IFF_BROADCAST);
-    key_value_flag_set(kv_link, NL_IS_LOOPBACK, ifi->ifi_flags, IFF_LOOPBACK);
-    key_value_flag_set(kv_link, NL_IS_PPP, ifi->ifi_flags, IFF_POINTOPOINT);
-    key_value_flag_set(kv_link, NL_IS_RUNNING, ifi->ifi_flags, IFF_RUNNING);
-    key_value_flag_set(kv_link, NL_IS_NOARP, ifi->ifi_flags, IFF_NOARP);
-    key_value_flag_set(kv_link, NL_IS_PROMISC, ifi->ifi_flags, IFF_PROMISC);
-    key_value_flag_set(kv_link, NL_IS_ALLMULTI, ifi->ifi_flags, IFF_ALLMULTI);
-    key_value_flag_set(kv_link, NL_IS_MASTER, ifi->ifi_flags, IFF_MASTER);
-    key_value_flag_set(kv_link, NL_IS_SLAVE, ifi->ifi_flags, IFF_SLAVE);
-    key_value_flag_set(kv_link, NL_IS_MULTICAST, ifi->ifi_flags,
-            IFF_MULTICAST);
-
-    rt_attrs_parse(tb_attrs, IFLA_MAX, IFLA_RTA(ifi),
-            msg->nlmsg_len);
-
-    if (tb_attrs[IFLA_ADDRESS])
-    {
-        key_value_cpy(kv_link, NL_ADDRESS, hw_addr_parse(RTA_DATA(
-            tb_attrs[IFLA_ADDRESS]), ifi->ifi_type));
-    }
-
-    if (tb_attrs[IFLA_BROADCAST])
-    {
-        key_value_set(kv_link, NL_BROADCAST, hw_addr_parse(RTA_DATA(
-            tb_attrs[IFLA_BROADCAST]), ifi->ifi_type));
-    }
-
-    if (tb_attrs[IFLA_MTU])
-    {
-        key_value_set(kv_link, NL_MTU, itoa(*(unsigned int *)RTA_DATA(
-            tb_attrs[IFLA_MTU])));
-    }
-
-    if (tb_attrs[IFLA_QDISC])
-    {
-        key_value_set(kv_link, NL_QDISC, RTA_DATA(
-            tb_attrs[IFLA_QDISC]));
-    }
-
-    return kv_link;
-}
-
-static key_value_t *rtnl_handle_addr(struct nlmsghdr *msg)
+static char *link_operstate_name_get(int operstate)
 {
-    struct rtattr *tb_attrs[IFA_MAX + 1];
-    struct ifaddrmsg *addr_msg = (struct ifaddrmsg *)NLMSG_DATA(msg);
-    char *ifa_family_name = ifa_family_name_get(addr_msg->ifa_family);
-    char *ifa_scope_name = ifa_scope_name_get(addr_msg->ifa_scope);
-
-    if (!ifa_family_name)
-        return NULL;
-
-    key_value_set(kv_addr, NL_FAMILY, ifa_family_name);
-    key_value_cpy(kv_addr, NL_PREFIXLEN,
-            itoa(addr_msg->ifa_prefixlen));
-
-    key_value_set(kv_addr, NL_SCOPE, ifa_scope_name);
-
-    if_indextoname(addr_msg->ifa_index, nl_if);
-
-    rt_attrs_parse(tb_attrs, IFA_MAX, IFA_RTA(addr_msg),
-            msg->nlmsg_len);
-
-    if (tb_attrs[IFA_ADDRESS])
-    {
-        inet_ntop(addr_msg->ifa_family, RTA_DATA(tb_attrs[IFA_ADDRESS]),
-                nl_address, sizeof(nl_address));
-    }
-
-    if (tb_attrs[IFA_LOCAL])
-    {
-        inet_ntop(addr_msg->ifa_family, RTA_DATA(tb_attrs[IFA_LOCAL]),
-                nl_local, sizeof(nl_local));
-    }
-
-    if (tb_attrs[IFA_LABEL])
+    switch (operstate)
     {
-        key_value_cpy(kv_addr, NL_LABEL,
-                RTA_DATA(tb_attrs[IFA_LABEL]));
+        case IF_OPER_UNKNOWN:
+            return "UNKNOWN";
+        case IF_OPER_NOTPRESENT:
+            return "NOTPRESENT";
+        case IF_OPER_DOWN:
+            return "DOWN";
+        case IF_OPER_LOWERLAYERDOWN:
+            return "LOWERLAYERDOWN";
+        case IF_OPER_TESTING:
+            return "TESTING";
+        case IF_OPER_DORMANT:
+            return "DORMANT";
+        case IF_OPER_UP:
+            return "UP";
     }
 
-    if (tb_attrs[IFA_BROADCAST])
-    {
-        inet_ntop(addr_msg->ifa_family,
-                RTA_DATA(tb_attrs[IFA_BROADCAST]), nl_broadcast,
-                sizeof(nl_broadcast));
-    }
-
-    if (tb_attrs[IFA_ANYCAST])
-    {
-        inet_ntop(addr_msg->ifa_family,
-                RTA_DATA(tb_attrs[IFA_ANYCAST]), nl_anycast,
-                sizeof(nl_anycast));
-    }
-
-    /* XXX add: IFA_CACHEINFO */
-
-    return kv_addr;
+    return NL_UNSPEC;
 }
 
-static key_value_t *rtnl_handle_neigh(struct nlmsghdr *msg)
+static void rtnl_addr_get(rtnl_addr_t *addr, struct rtattr *rta)
 {
-    struct ndmsg *nd_msg = (struct ndmsg *)NLMSG_DATA(msg);
-    struct rtattr *tb_attrs[NDA_MAX + 1];
+    if (!rta)
+        return;
 
-    key_value_set(kv_neigh, NL_FAMILY, ifa_family_name_get(nd_msg->ndm_family));
-
-    if_indextoname(nd_msg->ndm_ifindex, nl_if);
-
-    key_value_flag_set(kv_neigh, NL_IS_INCOMPLETE, nd_msg->ndm_state,
-        NUD_INCOMPLETE);
-    key_value_flag_set(kv_neigh, NL_IS_REACHABLE, nd_msg->ndm_state,
-        NUD_REACHABLE);
-    key_value_flag_set(kv_neigh, NL_IS_STALE, nd_msg->ndm_state, NUD_STALE);
-    key_value_flag_set(kv_neigh, NL_IS_DELAY, nd_msg->ndm_state, NUD_DELAY);
-    key_value_flag_set(kv_neigh, NL_IS_PROBE, nd_msg->ndm_state, NUD_PROBE);
-    key_value_flag_set(kv_neigh, NL_IS_FAILED, nd_msg->ndm_state, NUD_FAILED);
-
-    key_value_flag_set(kv_neigh, NL_IS_PROXY, nd_msg->ndm_flags, NTF_PROXY);
-    key_value_flag_set(kv_neigh, NL_IS_ROUTER, nd_msg->ndm_flags, NTF_ROUTER);
-
-    rt_attrs_parse(tb_attrs, NDA_MAX, NDA_RTA(nd_msg), msg->nlmsg_len);
-
-    if (tb_attrs[NDA_DST])
-    {
-        inet_ntop(nd_msg->ndm_family, RTA_DATA(tb_attrs[NDA_DST]),
-            nl_address, sizeof(nl_address));
-    }
-
-    if (tb_attrs[NDA_LLADDR])
-    {
-        key_value_cpy(kv_neigh, NL_LLADDR, hw_addr_parse(RTA_DATA(
-            tb_attrs[NDA_LLADDR]), ARPHRD_ETHER));
-    }
-
-    return kv_neigh;
+    addr->len = RTA_PAYLOAD(rta) > sizeof(addr->data) ?
+        sizeof(addr->data) : RTA_PAYLOAD(rta);
+    memcpy(addr->data, RTA_DATA(rta), addr->len);
 }
 
 static char *rt_table_name_get(int table_id)
@@ -301,9 +443,23 @@ static char *rt_table_name_get(int table_id)
             return "MAIN";
         case RT_TABLE_LOCAL:
             return "LOCAL";
+        case RT_TABLE_UNSPEC:
+            return NL_UNSPEC;
     }
 
-    return NL_UNSPEC;
+    return NULL;
+}
+
+/* tables without name are rendered by the number */
+static char *rt_table_name(unsigned int table, char *buf, int size)
+{
+    char *name = rt_table_name_get(table);
+
+    if (name)
+        return name;
+
+    snprintf(buf, size, "%u", table);
+    return buf;
 }
 
 static char *rt_name_get(int rt_type)
@@ -352,229 +508,1721 @@ static char *rt_proto_name_get(int rt_proto)
     return NL_UNSPEC;
 }
 
-static key_value_t *rtnl_handle_route(struct nlmsghdr *msg)
+static const rtnl_field_t rtnl_link_fields[] =
 {
-    struct rtmsg *rt_msg = (struct rtmsg *)NLMSG_DATA(msg);
-    struct rtattr *tb_attrs[RTA_MAX + 1];
-    char *scope_name = ifa_scope_name_get(rt_msg->rtm_scope);
+    { .key = NL_NETNS, .type = RTNL_F_NETNS },
+    { RTNL_KEY(NL_IF), .type = RTNL_F_IF, .offset = RTNL_EV(ifname),
+        .attr = IFLA_IFNAME },
+    { RTNL_KEY(NL_IS_UP), .type = RTNL_F_FLAG, .offset = RTNL_EV(flags),
+        .arg = IFF_UP },
+    { RTNL_KEY(NL_IS_BROADCAST), .type = RTNL_F_FLAG, .offset = RTNL_EV(flags),
+        .arg = IFF_BROADCAST },
+    { RTNL_KEY(NL_IS_LOOPBACK), .type = RTNL_F_FLAG, .offset = RTNL_EV(flags),
+        .arg = IFF_LOOPBACK },
+    { RTNL_KEY(NL_IS_PPP), .type = RTNL_F_FLAG, .offset = RTNL_EV(flags),
+        .arg = IFF_POINTOPOINT },
+    { RTNL_KEY(NL_IS_RUNNING), .type = RTNL_F_FLAG, .offset = RTNL_EV(flags),
+        .arg = IFF_RUNNING },
+    { RTNL_KEY(NL_IS_NOARP), .type = RTNL_F_FLAG, .offset = RTNL_EV(flags),
+        .arg = IFF_NOARP },
+    { RTNL_KEY(NL_IS_PROMISC), .type = RTNL_F_FLAG, .offset = RTNL_EV(flags),
+        .arg = IFF_PROMISC },
+    { RTNL_KEY(NL_IS_ALLMULTI), .type = RTNL_F_FLAG, .offset = RTNL_EV(flags),
+        .arg = IFF_ALLMULTI },
+    { RTNL_KEY(NL_IS_MASTER), .type = RTNL_F_FLAG, .offset = RTNL_EV(flags),
+        .arg = IFF_MASTER },
+    { RTNL_KEY(NL_IS_SLAVE), .type = RTNL_F_FLAG, .offset = RTNL_EV(flags),
+        .arg = IFF_SLAVE },
+    { RTNL_KEY(NL_IS_MULTICAST), .type = RTNL_F_FLAG, .offset = RTNL_EV(flags),
+        .arg = IFF_MULTICAST },
+    { RTNL_KEY(NL_ADDRESS), .type = RTNL_F_LLADDR, .offset = RTNL_EV(address),
+        .attr = IFLA_ADDRESS },
+    { RTNL_KEY(NL_BROADCAST), .type = RTNL_F_LLADDR,
+        .offset = RTNL_EV(broadcast), .attr = IFLA_BROADCAST },
+    { RTNL_KEY(NL_MTU), .type = RTNL_F_U32, .offset = RTNL_EV(mtu),
+        .arg = RTNL_HAS_MTU, .attr = IFLA_MTU },
+    { RTNL_KEY(NL_QDISC), .type = RTNL_F_STR, .offset = RTNL_EV(qdisc),
+        .attr = IFLA_QDISC },
+    { RTNL_KEY(NL_OPERSTATE), .type = RTNL_F_ENUM, .offset = RTNL_EV(operstate),
+        .attr = IFLA_OPERSTATE, .name = link_operstate_name_get },
+    { RTNL_KEY(NL_MASTER), .type = RTNL_F_IFINDEX, .offset = RTNL_EV(master),
+        .arg = RTNL_HAS_MASTER, .attr = IFLA_MASTER },
+    { RTNL_KEY(NL_KIND), .type = RTNL_F_NESTED, .offset = RTNL_EV(kind),
+        .attr = IFLA_LINKINFO, .pos = IFLA_INFO_KIND },
+    { .key = NL_RX_PACKETS, .type = RTNL_F_U64, RTNL_STATS(rx_packets) },
+    { .key = NL_TX_PACKETS, .type = RTNL_F_U64, RTNL_STATS(tx_packets) },
+    { .key = NL_RX_BYTES, .type = RTNL_F_U64, RTNL_STATS(rx_bytes) },
+    { .key = NL_TX_BYTES, .type = RTNL_F_U64, RTNL_STATS(tx_bytes) },
+    { .key = NL_RX_ERRORS, .type = RTNL_F_U64, RTNL_STATS(rx_errors) },
+    { .key = NL_TX_ERRORS, .type = RTNL_F_U64, RTNL_STATS(tx_errors) },
+    { .key = NL_RX_DROPPED, .type = RTNL_F_U64, RTNL_STATS(rx_dropped) },
+    { .key = NL_TX_DROPPED, .type = RTNL_F_U64, RTNL_STATS(tx_dropped) },
+};
+
+static const rtnl_field_t rtnl_addr_fields[] =
+{
+    { .key = NL_NETNS, .type = RTNL_F_NETNS },
+    { RTNL_KEY(NL_ANYCAST), .type = RTNL_F_INADDR, .offset = RTNL_EV(anycast),
+        .attr = IFA_ANYCAST },
+    { RTNL_KEY(NL_BROADCAST), .type = RTNL_F_INADDR,
+        .offset = RTNL_EV(broadcast), .attr = IFA_BROADCAST },
+    { RTNL_KEY(NL_LABEL), .type = RTNL_F_STR, .offset = RTNL_EV(label),
+        .attr = IFA_LABEL },
+    { RTNL_KEY(NL_LOCAL), .type = RTNL_F_INADDR, .offset = RTNL_EV(local),
+        .attr = IFA_LOCAL },
+    { RTNL_KEY(NL_ADDRESS), .type = RTNL_F_INADDR, .offset = RTNL_EV(address),
+        .attr = IFA_ADDRESS },
+    { RTNL_KEY(NL_IF), .type = RTNL_F_IF, .offset = RTNL_EV(ifname) },
+    { RTNL_KEY(NL_SCOPE), .type = RTNL_F_ENUM, .offset = RTNL_EV(scope),
+        .name = ifa_scope_name_get },
+    { RTNL_KEY(NL_PREFIXLEN), .type = RTNL_F_U8, .offset = RTNL_EV(prefixlen) },
+    { .key = NL_PREFERRED_LFT, .type = RTNL_F_U32,
+        RTNL_CACHEINFO(ifa_prefered) },
+    { .key = NL_VALID_LFT, .type = RTNL_F_U32, RTNL_CACHEINFO(ifa_valid) },
+    { RTNL_KEY(NL_FAMILY), .type = RTNL_F_ENUM, .offset = RTNL_EV(family),
+        .name = ifa_family_name_get },
+};
+
+static const rtnl_field_t rtnl_neigh_fields[] =
+{
+    { .key = NL_NETNS, .type = RTNL_F_NETNS },
+    { RTNL_KEY(NL_LLADDR), .type = RTNL_F_LLADDR, .offset = RTNL_EV(lladdr),
+        .attr = NDA_LLADDR },
+    { RTNL_KEY(NL_DST), .type = RTNL_F_INADDR, .offset = RTNL_EV(dst),
+        .attr = NDA_DST },
+    { RTNL_KEY(NL_VLAN), .type = RTNL_F_U16, .offset = RTNL_EV(vlan),
+        .arg = RTNL_HAS_VLAN, .attr = NDA_VLAN },
+    { RTNL_KEY(NL_IS_ROUTER), .type = RTNL_F_FLAG, .offset = RTNL_EV(flags),
+        .arg = NTF_ROUTER },
+    { RTNL_KEY(NL_IS_PROXY), .type = RTNL_F_FLAG, .offset = RTNL_EV(flags),
+        .arg = NTF_PROXY },
+    { RTNL_KEY(NL_IS_FAILED), .type = RTNL_F_FLAG, .offset = RTNL_EV(state),
+        .arg = NUD_FAILED },
+    { RTNL_KEY(NL_IS_PROBE), .type = RTNL_F_FLAG, .offset = RTNL_EV(state),
+        .arg = NUD_PROBE },
+    { RTNL_KEY(NL_IS_DELAY), .type = RTNL_F_FLAG, .offset = RTNL_EV(state),
+        .arg = NUD_DELAY },
+    { RTNL_KEY(NL_IS_STALE), .type = RTNL_F_FLAG, .offset = RTNL_EV(state),
+        .arg = NUD_STALE },
+    { RTNL_KEY(NL_IS_REACHABLE), .type = RTNL_F_FLAG, .offset = RTNL_EV(state),
+        .arg = NUD_REACHABLE },
+    { RTNL_KEY(NL_IS_INCOMPLETE), .type = RTNL_F_FLAG, .offset = RTNL_EV(state),
+        .arg = NUD_INCOMPLETE },
+    { RTNL_KEY(NL_IF), .type = RTNL_F_IF, .offset = RTNL_EV(ifname) },
+    { RTNL_KEY(NL_FAMILY), .type = RTNL_F_ENUM, .offset = RTNL_EV(family),
+        .name = ifa_family_name_get },
+};
 
-    key_value_set(kv_route, NL_FAMILY, ifa_family_name_get(rt_msg->rtm_family));
-    key_value_set(kv_route, NL_TABLE, rt_table_name_get(rt_msg->rtm_table));
-    key_value_set(kv_route, NL_ROUTE, rt_name_get(rt_msg->rtm_type));
-    key_value_set(kv_route, NL_PROTO, rt_proto_name_get(rt_msg->rtm_protocol));
-    key_value_set(kv_route, NL_SCOPE, scope_name);
+static const rtnl_field_t rtnl_route_fields[] =
+{
+    { .key = NL_NETNS, .type = RTNL_F_NETNS },
+    { RTNL_KEY(NL_OIF), .type = RTNL_F_IFINDEX, .offset = RTNL_EV(oif),
+        .arg = RTNL_HAS_OIF, .attr = RTA_OIF },
+    { RTNL_KEY(NL_IIF), .type = RTNL_F_IFINDEX, .offset = RTNL_EV(iif),
+        .arg = RTNL_HAS_IIF, .attr = RTA_IIF },
+    { RTNL_KEY(NL_METRICS), .type = RTNL_F_U32, .offset = RTNL_EV(metrics),
+        .arg = RTNL_HAS_METRICS, .attr = RTA_METRICS },
+    { RTNL_KEY(NL_PRIO), .type = RTNL_F_U32, .offset = RTNL_EV(prio),
+        .arg = RTNL_HAS_PRIO, .attr = RTA_PRIORITY },
+    { RTNL_KEY(NL_GATEWAY), .type = RTNL_F_INADDR, .offset = RTNL_EV(gateway),
+        .attr = RTA_GATEWAY },
+    { RTNL_KEY(NL_SRC), .type = RTNL_F_INADDR, .offset = RTNL_EV(src),
+        .attr = RTA_SRC },
+    { RTNL_KEY(NL_DST), .type = RTNL_F_INADDR, .offset = RTNL_EV(dst),
+        .attr = RTA_DST },
+    { RTNL_KEY(NL_NEXTHOPS), .type = RTNL_F_NEXTHOPS,
+        .offset = RTNL_EV(nexthops), .attr = RTA_MULTIPATH },
+    { RTNL_KEY(NL_SRC_LEN), .type = RTNL_F_U8, .offset = RTNL_EV(src_len) },
+    { RTNL_KEY(NL_DST_LEN), .type = RTNL_F_U8, .offset = RTNL_EV(dst_len) },
+    { RTNL_KEY(NL_TOS), .type = RTNL_F_U8, .offset = RTNL_EV(tos) },
+    { RTNL_KEY(NL_SCOPE), .type = RTNL_F_ENUM, .offset = RTNL_EV(scope),
+        .name = ifa_scope_name_get },
+    { RTNL_KEY(NL_PROTO), .type = RTNL_F_ENUM, .offset = RTNL_EV(proto),
+        .name = rt_proto_name_get },
+    { RTNL_KEY(NL_ROUTE), .type = RTNL_F_ENUM, .offset = RTNL_EV(rt_type),
+        .name = rt_name_get },
+    { RTNL_KEY(NL_TABLE), .type = RTNL_F_TABLE, .offset = RTNL_EV(table),
+        .attr = RTA_TABLE },
+    { RTNL_KEY(NL_FAMILY), .type = RTNL_F_ENUM, .offset = RTNL_EV(family),
+        .name = ifa_family_name_get },
+};
 
-    key_value_cpy(kv_route, NL_TOS, itoa(rt_msg->rtm_tos));
-    key_value_cpy(kv_route, NL_DST_LEN, itoa(rt_msg->rtm_dst_len));
-    key_value_cpy(kv_route, NL_SRC_LEN, itoa(rt_msg->rtm_src_len));
+/* fields are the bits of the unsigned int masks */
+#define RTNL_FIELDS_MAX (sizeof(unsigned int) * 8)
 
-    rt_attrs_parse(tb_attrs, RTA_MAX, RTM_RTA(rt_msg),
-            msg->nlmsg_len);
+_Static_assert(ARRAY_SIZE(rtnl_link_fields) <= RTNL_FIELDS_MAX,
+        "too many link fields");
+_Static_assert(ARRAY_SIZE(rtnl_addr_fields) <= RTNL_FIELDS_MAX,
+        "too many address fields");
+_Static_assert(ARRAY_SIZE(rtnl_neigh_fields) <= RTNL_FIELDS_MAX,
+        "too many neighbour fields");
+_Static_assert(ARRAY_SIZE(rtnl_route_fields) <= RTNL_FIELDS_MAX,
+        "too many route fields");
 
-    if (tb_attrs[RTA_DST])
+/* returns the variables of the object kind and their count */
+static int rtnl_fields_get(int type, const rtnl_field_t **fields)
+{
+    switch (RTNL_KIND(type))
     {
-        inet_ntop(rt_msg->rtm_family, RTA_DATA(tb_attrs[RTA_DST]), nl_dst,
-            sizeof(nl_dst));
+        case RTM_NEWLINK:
+            *fields = rtnl_link_fields;
+            return ARRAY_SIZE(rtnl_link_fields);
+        case RTM_NEWADDR:
+            *fields = rtnl_addr_fields;
+            return ARRAY_SIZE(rtnl_addr_fields);
+        case RTM_NEWROUTE:
+            *fields = rtnl_route_fields;
+            return ARRAY_SIZE(rtnl_route_fields);
+        case RTM_NEWNEIGH:
+            *fields = rtnl_neigh_fields;
+            return ARRAY_SIZE(rtnl_neigh_fields);
     }
 
-    if (tb_attrs[RTA_SRC])
+    *fields = NULL;
+    return 0;
+}
+
+/* mask of the fields of the object kind with the keys */
+static unsigned int rtnl_fields_mask(int type, char **keys)
+{
+    const rtnl_field_t *fields;
+    int i, count = rtnl_fields_get(type, &fields);
+    unsigned int mask = 0;
+
+    for (; *keys; keys++)
     {
-        inet_ntop(rt_msg->rtm_family, RTA_DATA(tb_attrs[RTA_SRC]), nl_src,
-            sizeof(nl_src));
+        for (i = 0; i < count; i++)
+        {
+            if (!strcmp(fields[i].key, *keys))
+                mask |= 1u << i;
+        }
     }
 
-    if (tb_attrs[RTA_GATEWAY])
+    return mask;
+}
+
+/* fills the header fields and finds the attributes of the message */
+static int rtnl_parse_hdr(struct nlmsghdr *msg, rtnl_event_t *ev)
+{
+    struct ifinfomsg *ifi;
+    struct ifaddrmsg *ifa;
+    struct ndmsg *ndm;
+    struct rtmsg *rtm;
+
+    switch (msg->nlmsg_type)
     {
-        inet_ntop(rt_msg->rtm_family, RTA_DATA(tb_attrs[RTA_GATEWAY]),
-            nl_gateway, sizeof(nl_gateway));
+        case RTM_NEWLINK:
+        case RTM_DELLINK:
+            ifi = (struct ifinfomsg *)NLMSG_DATA(msg);
+            ev->ifindex = ifi->ifi_index;
+            ev->flags = ifi->ifi_flags;
+            ev->hw_type = ifi->ifi_type;
+
+            ev->rta = IFLA_RTA(ifi);
+            ev->rta_len = IFLA_PAYLOAD(msg);
+            ev->rta_max = IFLA_MAX;
+            return 0;
+
+        case RTM_NEWADDR:
+        case RTM_DELADDR:
+            ifa = (struct ifaddrmsg *)NLMSG_DATA(msg);
+
+            if (!ifa_family_name_get(ifa->ifa_family))
+                return -1;
+
+            ev->family = ifa->ifa_family;
+            ev->prefixlen = ifa->ifa_prefixlen;
+            ev->scope = ifa->ifa_scope;
+            ev->ifindex = ifa->ifa_index;
+
+            ev->rta = IFA_RTA(ifa);
+            ev->rta_len = IFA_PAYLOAD(msg);
+            ev->rta_max = IFA_MAX;
+            return 0;
+
+        case RTM_NEWNEIGH:
+        case RTM_DELNEIGH:
+            ndm = (struct ndmsg *)NLMSG_DATA(msg);
+            ev->family = ndm->ndm_family;
+            ev->ifindex = ndm->ndm_ifindex;
+            ev->state = ndm->ndm_state;
+            ev->flags = ndm->ndm_flags;
+            ev->hw_type = ARPHRD_ETHER;
+
+            ev->rta = NDA_RTA(ndm);
+            ev->rta_len = NDA_PAYLOAD(msg);
+            ev->rta_max = NDA_MAX;
+            return 0;
+
+        case RTM_NEWROUTE:
+        case RTM_DELROUTE:
+            rtm = (struct rtmsg *)NLMSG_DATA(msg);
+            ev->family = rtm->rtm_family;
+            ev->table = rtm->rtm_table;
+            ev->rt_type = rtm->rtm_type;
+            ev->proto = rtm->rtm_protocol;
+            ev->scope = rtm->rtm_scope;
+            ev->tos = rtm->rtm_tos;
+            ev->dst_len = rtm->rtm_dst_len;
+            ev->src_len = rtm->rtm_src_len;
+
+            ev->rta = RTM_RTA(rtm);
+            ev->rta_len = RTM_PAYLOAD(msg);
+            ev->rta_max = RTA_MAX;
+            return 0;
     }
 
-    if (tb_attrs[RTA_PRIORITY])
+    return -1;
+}
+
+static struct rtattr *rtnl_attr_find(struct rtattr *rta, int len, int type)
+{
+    for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len))
     {
-        key_value_cpy(kv_route, NL_PRIO,
-            itoa(*(unsigned int *)RTA_DATA(tb_attrs[RTA_PRIORITY])));
+        if (rta->rta_type == type)
+            return rta;
     }
 
-    if (tb_attrs[RTA_METRICS])
+    return NULL;
+}
+
+static void rtnl_nexthops_get(rtnl_nexthops_t *nh, struct rtattr *rta)
+{
+    struct rtnexthop *rtnh = (struct rtnexthop *)RTA_DATA(rta);
+    int len = RTA_PAYLOAD(rta);
+
+    memset(nh, 0, sizeof(*nh));
+
+    while (RTNH_OK(rtnh, len) && nh->count < RTNL_NEXTHOPS_MAX)
     {
-        key_value_cpy(kv_route, NL_METRICS,
-            itoa(*(unsigned int *)RTA_DATA(tb_attrs[RTA_METRICS])));
+        nh->hop[nh->count].ifindex = rtnh->rtnh_ifindex;
+        rtnl_addr_get(&nh->hop[nh->count].gateway,
+                rtnl_attr_find(RTNH_DATA(rtnh), rtnh->rtnh_len - sizeof(*rtnh),
+                    RTA_GATEWAY));
+        nh->count++;
+
+        len -= RTNH_ALIGN(rtnh->rtnh_len);
+        rtnh = RTNH_NEXT(rtnh);
     }
+}
 
-    if (tb_attrs[RTA_IIF])
+/* size of the value in the attribute, 0 if it is not fixed */
+static int rtnl_field_size(const rtnl_field_t *field)
+{
+    switch (field->type)
     {
-        if_indextoname(*(int *)RTA_DATA(tb_attrs[RTA_IIF]), nl_iif);
+        case RTNL_F_ENUM:
+        case RTNL_F_U8:
+            return sizeof(unsigned char);
+        case RTNL_F_U16:
+            return sizeof(unsigned short);
+        case RTNL_F_U32:
+        case RTNL_F_IFINDEX:
+        case RTNL_F_TABLE:
+            return sizeof(unsigned int);
+        case RTNL_F_U64:
+            return sizeof(unsigned long long);
     }
 
-    if (tb_attrs[RTA_OIF])
+    return 0;
+}
+
+static void rtnl_field_decode(const rtnl_field_t *field, rtnl_event_t *ev,
+        struct rtattr *rta)
+{
+    void *val = (char *)ev + field->offset;
+    int size = rtnl_field_size(field);
+
+    if (size)
     {
-        if_indextoname(*(int *)RTA_DATA(tb_attrs[RTA_OIF]), nl_oif);
+        if ((int)RTA_PAYLOAD(rta) < field->pos + size)
+            return;
+
+        memcpy(val, (char *)RTA_DATA(rta) + field->pos, size);
+        ev->has |= field->arg;
+        return;
     }
 
-    return kv_route;
+    switch (field->type)
+    {
+        case RTNL_F_INADDR:
+        case RTNL_F_LLADDR:
+            rtnl_addr_get((rtnl_addr_t *)val, rta);
+            break;
+
+        case RTNL_F_NESTED:
+            if (!(rta = rtnl_attr_find(RTA_DATA(rta), RTA_PAYLOAD(rta),
+                            field->pos)))
+            {
+                break;
+            }
+            /* fall through */
+
+        /* all the strings of the record are IFNAMSIZ long */
+        case RTNL_F_STR:
+        case RTNL_F_IF:
+            snprintf((char *)val, IFNAMSIZ, "%.*s", (int)RTA_PAYLOAD(rta),
+                    (char *)RTA_DATA(rta));
+            break;
+
+        case RTNL_F_NEXTHOPS:
+            rtnl_nexthops_get((rtnl_nexthops_t *)val, rta);
+            break;
+    }
 }
 
-static void nl_vars_cleanup()
+/* fields of each kind decoded from the attribute, indexed by its type */
+static unsigned int rtnl_attr_fields[RTNL_KINDS][RTNL_ATTRS_MAX + 1];
+
+static void rtnl_attr_fields_init(void)
 {
-    /* clean up values */
-    nl_qdisc[0] = '\0';
-    nl_mtu[0] = '\0';
-    nl_broadcast[0] = '\0';
-    nl_address[0] = '\0';
-    nl_local[0] = '\0';
-    nl_anycast[0] = '\0';
-    nl_label[0] = '\0';
-    nl_if[0] = '\0';
-    nl_prefixlen[0] = '\0';
-    nl_lladdr[0] = '\0';
-    nl_dst_len[0] = '\0';
-    nl_src_len[0] = '\0';
-    nl_tos[0] = '\0';
-    nl_dst[0] = '\0';
-    nl_src[0] = '\0';
-    nl_gateway[0] = '\0';
-    nl_prio[0] = '\0';
-    nl_metrics[0] = '\0';
-    nl_iif[0] = '\0';
-    nl_oif[0] = '\0';
+    const rtnl_field_t *fields;
+    int i, kind, count;
+
+    for (kind = 0; kind < RTNL_KINDS; kind++)
+    {
+        count = rtnl_fields_get(RTM_NEWLINK + (kind << 2), &fields);
+
+        for (i = 0; i < count; i++)
+        {
+            if (fields[i].attr)
+                rtnl_attr_fields[kind][fields[i].attr] |= 1u << i;
+        }
+    }
 }
 
-static void rtnl_handle(nl_sock_t *nl_sock, void *buf, int len)
+/*
+ * Decodes the attributes of the fields in need which are not decoded yet, in
+ * one pass over the attributes of the message.
+ */
+static void rtnl_decode(rtnl_event_t *ev, unsigned int need)
 {
-    char *event_name;
-    struct nlmsghdr *msg;
-    key_value_t *kv = NULL;
+    unsigned int *attr_fields = rtnl_attr_fields[RTNL_KIND_INDEX(ev->type)];
+    const rtnl_field_t *fields;
+    struct rtattr *rta;
+    unsigned int mask;
+    int len;
 
-    for_each_nlmsg(buf, msg, len)
-    {
-        kv = NULL;
-        event_name = event_name_get(msg->nlmsg_type);
+    if (!(need &= ~ev->decoded))
+        return;
 
-        /* not supported RTNETLINK type */
-        if (!event_name)
-            return;
+    ev->decoded |= need;
+    rtnl_fields_get(ev->type, &fields);
 
-        nl_vars_cleanup();
+    for (rta = ev->rta, len = ev->rta_len; RTA_OK(rta, len);
+            rta = RTA_NEXT(rta, len))
+    {
+        if (rta->rta_type > ev->rta_max)
+            continue;
 
-        switch (msg->nlmsg_type)
+        for (mask = attr_fields[rta->rta_type] & need; mask;
+                mask &= mask - 1)
         {
-            case RTM_NEWADDR:
-            case RTM_DELADDR:
-                kv = rtnl_handle_addr(msg);
-                break;
-            case RTM_NEWLINK:
-            case RTM_DELLINK:
-                kv = rtnl_handle_link(msg);
-                break;
-            case RTM_NEWNEIGH:
-            case RTM_DELNEIGH:
-                {
-                    kv = rtnl_handle_neigh(msg);
-                    break;
-                }
-            case RTM_NEWROUTE:
-            case RTM_DELROUTE:
-                {
-                    kv = rtnl_handle_route(msg);
-                    break;
-                }
-            default:
-                kv = NULL;
+            rtnl_field_decode(&fields[ffs(mask) - 1], ev, rta);
         }
+    }
+}
 
-        if (!kv)
-            continue;
+/*
+ * Fills the record of the object, only the attributes of the fields in need
+ * are decoded. Returns -1 if the message is not handled.
+ */
+static int rtnl_parse(struct nlmsghdr *msg, rtnl_event_t *ev,
+        unsigned int need)
+{
+    memset(ev, 0, sizeof(rtnl_event_t));
+    ev->type = msg->nlmsg_type;
+
+    if (rtnl_parse_hdr(msg, ev))
+        return -1;
+
+    rtnl_decode(ev, need);
+    return 0;
+}
 
-        key_value_set(kv, NL_EVENT, event_name);
+/* compares all the fields of the object with its last known state */
+static int rtnl_field_equal(const rtnl_field_t *field, rtnl_event_t *a,
+        rtnl_event_t *b)
+{
+    void *val_a = (char *)a + field->offset;
+    void *val_b = (char *)b + field->offset;
 
-        event_nlmsg_send(kv);
+    switch (field->type)
+    {
+        case RTNL_F_ENUM:
+        case RTNL_F_U8:
+        case RTNL_F_U16:
+        case RTNL_F_U32:
+        case RTNL_F_U64:
+        case RTNL_F_IFINDEX:
+        case RTNL_F_TABLE:
+            if ((a->has ^ b->has) & field->arg)
+                return 0;
+
+            return !memcmp(val_a, val_b, rtnl_field_size(field));
+
+        case RTNL_F_FLAG:
+            return !((*(unsigned int *)val_a ^ *(unsigned int *)val_b) &
+                    field->arg);
+
+        case RTNL_F_LLADDR:
+            if (a->hw_type != b->hw_type)
+                return 0;
+            /* fall through */
+
+        case RTNL_F_INADDR:
+            return !memcmp(val_a, val_b, sizeof(rtnl_addr_t));
+
+        case RTNL_F_STR:
+        case RTNL_F_NESTED:
+        case RTNL_F_IF:
+            return !strcmp((char *)val_a, (char *)val_b);
+
+        case RTNL_F_NEXTHOPS:
+            return !memcmp(val_a, val_b, sizeof(rtnl_nexthops_t));
     }
+
+    return 1;
 }
 
-static void rtnl_handler_init(void)
+/* counters are not compared, they are not kept in the state */
+static int rtnl_obj_changed(rtnl_obj_t *obj, rtnl_event_t *ev)
+{
+    const rtnl_field_t *fields;
+    int i, count = rtnl_fields_get(ev->type, &fields);
+    rtnl_event_t old;
+
+    if (rtnl_parse(obj->msg, &old, ~0u))
+        return 1;
+
+    rtnl_decode(ev, ~0u);
+
+    for (i = 0; i < count; i++)
+    {
+        if (fields[i].old_key && !rtnl_field_equal(&fields[i], &old, ev))
+            return 1;
+    }
+
+    return 0;
+}
+
+static int rtnl_attr_is_kept(int type, int attr)
 {
-    rtnl_sock = nl_sock_create(NETLINK_ROUTE, RTMGRP_LINK | RTMGRP_IPV4_IFADDR |
-	RTMGRP_IPV6_IFADDR | RTMGRP_NEIGH | RTMGRP_IPV4_ROUTE |
-        RTMGRP_IPV6_ROUTE);
-
-    nl_sock_register_cb(rtnl_sock, rtnl_handle);
-
-    kv_link = key_value_add(kv_link, NL_QDISC, nl_qdisc);
-    kv_link = key_value_add(kv_link, NL_MTU, nl_mtu);
-    kv_link = key_value_add(kv_link, NL_BROADCAST, nl_broadcast);
-    kv_link = key_value_add(kv_link, NL_ADDRESS, nl_address);
-    kv_link = key_value_add(kv_link, NL_IS_MULTICAST, NULL);
-    kv_link = key_value_add(kv_link, NL_IS_SLAVE, NULL);
-    kv_link = key_value_add(kv_link, NL_IS_MASTER, NULL);
-    kv_link = key_value_add(kv_link, NL_IS_ALLMULTI, NULL);
-    kv_link = key_value_add(kv_link, NL_IS_PROMISC, NULL);
-    kv_link = key_value_add(kv_link, NL_IS_NOARP, NULL);
-    kv_link = key_value_add(kv_link, NL_IS_RUNNING, NULL);
-    kv_link = key_value_add(kv_link, NL_IS_PPP, NULL);
-    kv_link = key_value_add(kv_link, NL_IS_LOOPBACK, NULL);
-    kv_link = key_value_add(kv_link, NL_IS_BROADCAST, NULL);
-    kv_link = key_value_add(kv_link, NL_IS_UP, NULL);
-    kv_link = key_value_add(kv_link, NL_IF, nl_if);
-    kv_link = key_value_add(kv_link, NL_EVENT, NULL);
-    kv_link = key_value_add(kv_link, NL_TYPE, "ROUTE");
-
-    kv_addr = key_value_add(kv_addr, NL_FAMILY, NULL);
-    kv_addr = key_value_add(kv_addr, NL_PREFIXLEN, nl_prefixlen);
-    kv_addr = key_value_add(kv_addr, NL_SCOPE, NULL);
-    kv_addr = key_value_add(kv_addr, NL_IF, nl_if);
-    kv_addr = key_value_add(kv_addr, NL_ADDRESS, nl_address);
-    kv_addr = key_value_add(kv_addr, NL_LOCAL, NULL);
-    kv_addr = key_value_add(kv_addr, NL_LABEL, nl_label);
-    kv_addr = key_value_add(kv_addr, NL_BROADCAST, nl_broadcast);
-    kv_addr = key_value_add(kv_addr, NL_ANYCAST, nl_anycast);
-    kv_addr = key_value_add(kv_addr, NL_EVENT, NULL);
-    kv_addr = key_value_add(kv_addr, NL_TYPE, "ROUTE");
-
-    kv_neigh = key_value_add(kv_neigh, NL_FAMILY, NULL);
-    kv_neigh = key_value_add(kv_neigh, NL_IF, nl_if);
-    kv_neigh = key_value_add(kv_neigh, NL_IS_INCOMPLETE, NULL);
-    kv_neigh = key_value_add(kv_neigh, NL_IS_REACHABLE, NULL);
-    kv_neigh = key_value_add(kv_neigh, NL_IS_STALE, NULL);
-    kv_neigh = key_value_add(kv_neigh, NL_IS_DELAY, NULL);
-    kv_neigh = key_value_add(kv_neigh, NL_IS_PROBE, NULL);
-    kv_neigh = key_value_add(kv_neigh, NL_IS_FAILED, NULL);
-    kv_neigh = key_value_add(kv_neigh, NL_IS_PROXY, NULL);
-    kv_neigh = key_value_add(kv_neigh, NL_IS_ROUTER, NULL);
-    kv_neigh = key_value_add(kv_neigh, NL_DST, nl_address);
-    kv_neigh = key_value_add(kv_neigh, NL_LLADDR, nl_lladdr);
-    kv_neigh = key_value_add(kv_neigh, NL_EVENT, NULL);
-    kv_neigh = key_value_add(kv_neigh, NL_TYPE, "ROUTE");
-
-    kv_route = key_value_add(kv_route, NL_FAMILY, NULL);
-    kv_route = key_value_add(kv_route, NL_TABLE, NULL);
-    kv_route = key_value_add(kv_route, NL_ROUTE, NULL);
-    kv_route = key_value_add(kv_route, NL_PROTO, NULL);
-    kv_route = key_value_add(kv_route, NL_SCOPE, NULL);
-    kv_route = key_value_add(kv_route, NL_TOS, nl_tos);
-    kv_route = key_value_add(kv_route, NL_DST_LEN, nl_dst_len);
-    kv_route = key_value_add(kv_route, NL_SRC_LEN, nl_src_len);
-    kv_route = key_value_add(kv_route, NL_DST, nl_dst);
-    kv_route = key_value_add(kv_route, NL_SRC, nl_src);
-    kv_route = key_value_add(kv_route, NL_GATEWAY, nl_gateway);
-    kv_route = key_value_add(kv_route, NL_PRIO, nl_prio);
-    kv_route = key_value_add(kv_route, NL_METRICS, nl_metrics);
-    kv_route = key_value_add(kv_route, NL_IIF, nl_iif);
-    kv_route = key_value_add(kv_route, NL_OIF, nl_oif);
-    kv_route = key_value_add(kv_route, NL_EVENT, NULL);
-    kv_route = key_value_add(kv_route, NL_TYPE, "ROUTE");
+    const rtnl_field_t *fields;
+    int i, count = rtnl_fields_get(type, &fields);
+
+    for (i = 0; i < count; i++)
+    {
+        if (fields[i].attr == attr && fields[i].old_key)
+            return 1;
+    }
+
+    return 0;
 }
 
-static void rtnl_handler_cleanup(void)
+/*
+ * Copies the message without the attributes which are not used by the events
+ * and the counters (stats, cache info), it is enough to keep the object state.
+ */
+static struct nlmsghdr *rtnl_msg_compact(struct nlmsghdr *msg)
+{
+    struct nlmsghdr *copy;
+    struct rtattr *rta;
+    rtnl_event_t ev;
+    char *pos;
+    int len;
+
+    copy = (struct nlmsghdr *)malloc(NLMSG_ALIGN(msg->nlmsg_len));
+
+    if (rtnl_parse_hdr(msg, &ev))
+    {
+        memcpy(copy, msg, msg->nlmsg_len);
+        return copy;
+    }
+
+    len = (char *)ev.rta - (char *)msg;
+    memcpy(copy, msg, len);
+    pos = (char *)copy + len;
+
+    for (rta = ev.rta; RTA_OK(rta, ev.rta_len);
+            rta = RTA_NEXT(rta, ev.rta_len))
+    {
+        if (!rtnl_attr_is_kept(msg->nlmsg_type, rta->rta_type))
+            continue;
+
+        memcpy(pos, rta, rta->rta_len);
+        memset(pos + rta->rta_len, 0, RTA_ALIGN(rta->rta_len) - rta->rta_len);
+        pos += RTA_ALIGN(rta->rta_len);
+    }
+
+    copy->nlmsg_len = pos - (char *)copy;
+
+    /* the kept state may be large, give the rest back */
+    return (struct nlmsghdr *)realloc(copy, copy->nlmsg_len);
+}
+
+static char *rtnl_netns_name(int id, char *buf, int size)
 {
-    nl_sock_free(rtnl_sock);
+    rtnl_ns_t *ns;
+
+    if (id >= RTNL_NS_NSID)
+    {
+        snprintf(buf, size, "%d", id - RTNL_NS_NSID);
+        return buf;
+    }
+
+    for (ns = rtnl_ns_list; ns && ns->id != id; ns = ns->next)
+        ;
+
+    return ns && ns->name ? ns->name : "";
+}
+
+/* "GATEWAY@IF ..." of each nexthop, the gateway may be omitted */
+static char *rtnl_nexthops_render(rtnl_nexthops_t *nh, rtnl_event_t *ev,
+        char *buf, int size)
+{
+    char gateway[INET6_ADDRSTRLEN];
+    int i, len = 0;
+
+    buf[0] = '\0';
+
+    for (i = 0; i < nh->count && len < size; i++)
+    {
+        gateway[0] = '\0';
+
+        if (nh->hop[i].gateway.len)
+        {
+            inet_ntop(ev->family, nh->hop[i].gateway.data, gateway,
+                    sizeof(gateway));
+        }
+
+        len += snprintf(buf + len, size - len, "%s%s@%s", i ? " " : "",
+                gateway, rtnl_ifname_get(ev->ns, nh->hop[i].ifindex));
+    }
+
+    return buf;
+}
+
+/* absent attributes are rendered as empty values */
+static char *rtnl_var_render(key_value_t *kv)
+{
+    rtnl_var_t *var = (rtnl_var_t *)kv;
+    const rtnl_field_t *field = var->field;
+    rtnl_event_t *ev = var->ev;
+    void *val = (char *)ev + field->offset;
+    rtnl_addr_t *addr = (rtnl_addr_t *)val;
+
+    /* the program needs all the values if the rules didn't look at this one */
+    if (field->attr && !(ev->decoded & var->bit))
+        rtnl_decode(ev, ~0u);
+
+    if (var->cmp)
+    {
+        rtnl_decode(var->cmp, ~0u);
+
+        if (rtnl_field_equal(field, ev, var->cmp))
+            return NULL;
+    }
+
+    switch (field->type)
+    {
+        case RTNL_F_ENUM:
+            return field->name(*(unsigned char *)val);
+
+        case RTNL_F_U8:
+            snprintf(var->buf, sizeof(var->buf), "%u", *(unsigned char *)val);
+            return var->buf;
+
+        case RTNL_F_U16:
+            if (!(ev->has & field->arg))
+                return "";
+
+            snprintf(var->buf, sizeof(var->buf), "%u", *(unsigned short *)val);
+            return var->buf;
+
+        case RTNL_F_U32:
+            if (!(ev->has & field->arg))
+                return "";
+
+            snprintf(var->buf, sizeof(var->buf), "%u", *(unsigned int *)val);
+            return var->buf;
+
+        case RTNL_F_U64:
+            if (!(ev->has & field->arg))
+                return "";
+
+            snprintf(var->buf, sizeof(var->buf), "%llu",
+                    *(unsigned long long *)val);
+            return var->buf;
+
+        case RTNL_F_TABLE:
+            return rt_table_name(*(unsigned int *)val, var->buf,
+                    sizeof(var->buf));
+
+        case RTNL_F_NEXTHOPS:
+            return rtnl_nexthops_render((rtnl_nexthops_t *)val, ev, var->buf,
+                    sizeof(var->buf));
+
+        case RTNL_F_FLAG:
+            return *(unsigned int *)val & field->arg ? "TRUE" : "FALSE";
+
+        case RTNL_F_INADDR:
+            if (!addr->len || !inet_ntop(ev->family, addr->data, var->buf,
+                        sizeof(var->buf)))
+            {
+                return "";
+            }
+
+            return var->buf;
+
+        case RTNL_F_LLADDR:
+            if (!addr->len)
+                return "";
+
+            if (ev->hw_type != ARPHRD_ETHER)
+                return NL_UNSPEC;
+
+            return ether_ntoa_r((struct ether_addr *)addr->data, var->buf);
+
+        case RTNL_F_STR:
+        case RTNL_F_NESTED:
+            return (char *)val;
+
+        case RTNL_F_IF:
+            if (ev->ifname[0])
+                return ev->ifname;
+
+            return rtnl_ifname_get(ev->ns, ev->ifindex);
+
+        case RTNL_F_IFINDEX:
+            if (!(ev->has & field->arg))
+                return "";
+
+            return rtnl_ifname_get(ev->ns, *(int *)val);
+
+        case RTNL_F_NETNS:
+            return rtnl_netns_name(ev->ns, var->buf, sizeof(var->buf));
+    }
+
+    return NULL;
+}
+
+/* binds the variables of the object kind to the record */
+static key_value_t *rtnl_var_bind(rtnl_var_t *var, key_value_t *next,
+        char *key, const rtnl_field_t *field, unsigned int bit,
+        rtnl_event_t *ev, rtnl_event_t *cmp)
+{
+    var->kv.next = next;
+    var->kv.key = key;
+    var->kv.value = NULL;
+    var->kv.render = rtnl_var_render;
+    var->field = field;
+    var->bit = bit;
+    var->ev = ev;
+    var->cmp = cmp;
+
+    return &var->kv;
+}
+
+/*
+ * Binds the variables of the object kind to the record, OLD_* variables are
+ * bound to the last known state of the object if there is one.
+ */
+static key_value_t *rtnl_vars_set(rtnl_var_t *vars, rtnl_event_t *ev,
+        rtnl_event_t *old, int type, char *event_name)
+{
+    const rtnl_field_t *fields;
+    int i, count = rtnl_fields_get(type, &fields);
+    rtnl_var_t *var = &vars[2];
+    key_value_t *kv = NULL;
+
+    for (i = count - 1; old && i >= 0; i--)
+    {
+        if (fields[i].old_key)
+        {
+            kv = rtnl_var_bind(var++, kv, fields[i].old_key, &fields[i],
+                    1u << i, old, ev);
+        }
+    }
+
+    for (i = count - 1; i >= 0; i--)
+        kv = rtnl_var_bind(var++, kv, fields[i].key, &fields[i], 1u << i, ev,
+                NULL);
+
+    vars[1].kv = (key_value_t){ .next = kv, .key = NL_EVENT,
+        .value = event_name };
+    vars[0].kv = (key_value_t){ .next = &vars[1].kv, .key = NL_TYPE,
+        .value = "ROUTE" };
+
+    return &vars[0].kv;
+}
+
+static int rtnl_is_del(int type)
+{
+    return type == RTM_DELLINK || type == RTM_DELADDR ||
+        type == RTM_DELNEIGH || type == RTM_DELROUTE;
+}
+
+static unsigned char *key_put(unsigned char *key, void *data, int len)
+{
+    memcpy(key, data, len);
+    return key + len;
+}
+
+static unsigned char *key_put_attr(unsigned char *key, struct rtattr *rta)
+{
+    int len;
+
+    if (!rta)
+        return key;
+
+    len = RTA_PAYLOAD(rta) > 16 ? 16 : RTA_PAYLOAD(rta);
+    return key_put(key, RTA_DATA(rta), len);
+}
+
+/*
+ * Builds the key which identifies the object in the kernel, returns key
+ * length and fills the interface index the object belongs to.
+ */
+static int rtnl_obj_key(struct nlmsghdr *msg, int ns, unsigned char *key,
+    int *ifindex)
+{
+    unsigned char *pos = key;
+    struct rtattr *tb_attrs[RTA_MAX + 1];
+    struct ifinfomsg *ifi;
+    struct ifaddrmsg *ifa;
+    struct ndmsg *ndm;
+    struct rtmsg *rtm;
+    unsigned int table;
+
+    /* message kind goes first to not mix up the objects of each kind */
+    *pos++ = RTNL_KIND(msg->nlmsg_type);
+    pos = key_put(pos, &ns, sizeof(ns));
+
+    switch (msg->nlmsg_type)
+    {
+        case RTM_NEWLINK:
+        case RTM_DELLINK:
+            ifi = (struct ifinfomsg *)NLMSG_DATA(msg);
+            *ifindex = ifi->ifi_index;
+            pos = key_put(pos, &ifi->ifi_index, sizeof(ifi->ifi_index));
+            break;
+
+        case RTM_NEWADDR:
+        case RTM_DELADDR:
+            ifa = (struct ifaddrmsg *)NLMSG_DATA(msg);
+            *ifindex = ifa->ifa_index;
+            rt_attrs_parse(tb_attrs, IFA_MAX, IFA_RTA(ifa), IFA_PAYLOAD(msg));
+
+            pos = key_put(pos, &ifa->ifa_family, sizeof(ifa->ifa_family));
+            pos = key_put(pos, &ifa->ifa_prefixlen,
+                    sizeof(ifa->ifa_prefixlen));
+            pos = key_put(pos, &ifa->ifa_index, sizeof(ifa->ifa_index));
+            pos = key_put_attr(pos, tb_attrs[IFA_LOCAL]);
+            pos = key_put_attr(pos, tb_attrs[IFA_ADDRESS]);
+            break;
+
+        case RTM_NEWNEIGH:
+        case RTM_DELNEIGH:
+            ndm = (struct ndmsg *)NLMSG_DATA(msg);
+            *ifindex = ndm->ndm_ifindex;
+            rt_attrs_parse(tb_attrs, NDA_MAX, NDA_RTA(ndm), NDA_PAYLOAD(msg));
+
+            pos = key_put(pos, &ndm->ndm_family, sizeof(ndm->ndm_family));
+            pos = key_put(pos, &ndm->ndm_ifindex, sizeof(ndm->ndm_ifindex));
+            pos = key_put_attr(pos, tb_attrs[NDA_DST]);
+            break;
+
+        case RTM_NEWROUTE:
+        case RTM_DELROUTE:
+            rtm = (struct rtmsg *)NLMSG_DATA(msg);
+            rt_attrs_parse(tb_attrs, RTA_MAX, RTM_RTA(rtm), RTM_PAYLOAD(msg));
+
+            table = tb_attrs[RTA_TABLE] ?
+                *(unsigned int *)RTA_DATA(tb_attrs[RTA_TABLE]) :
+                rtm->rtm_table;
+            *ifindex = tb_attrs[RTA_OIF] ?
+                *(int *)RTA_DATA(tb_attrs[RTA_OIF]) : 0;
+
+            pos = key_put(pos, &rtm->rtm_family, sizeof(rtm->rtm_family));
+            pos = key_put(pos, &rtm->rtm_dst_len, sizeof(rtm->rtm_dst_len));
+            pos = key_put(pos, &rtm->rtm_tos, sizeof(rtm->rtm_tos));
+            pos = key_put(pos, &table, sizeof(table));
+            pos = key_put_attr(pos, tb_attrs[RTA_PRIORITY]);
+            pos = key_put_attr(pos, tb_attrs[RTA_DST]);
+
+            /* IPv6 keeps the nexthops of the same prefix as separate routes */
+            if (rtm->rtm_family == AF_INET6)
+            {
+                pos = key_put_attr(pos, tb_attrs[RTA_SRC]);
+                pos = key_put_attr(pos, tb_attrs[RTA_OIF]);
+                pos = key_put_attr(pos, tb_attrs[RTA_GATEWAY]);
+            }
+            break;
+    }
+
+    return pos - key;
+}
+
+/* multicast group the message of the object is sent to */
+static unsigned int rtnl_msg_group(struct nlmsghdr *msg)
+{
+    int i, family = AF_UNSPEC;
+
+    if (RTNL_KIND(msg->nlmsg_type) == RTM_NEWADDR)
+        family = ((struct ifaddrmsg *)NLMSG_DATA(msg))->ifa_family;
+    else if (RTNL_KIND(msg->nlmsg_type) == RTM_NEWROUTE)
+        family = ((struct rtmsg *)NLMSG_DATA(msg))->rtm_family;
+
+    for (i = 0; i < ARRAY_SIZE(rtnl_groups_list); i++)
+    {
+        if (rtnl_groups_list[i].kind == RTNL_KIND(msg->nlmsg_type) &&
+                (rtnl_groups_list[i].family == AF_UNSPEC ||
+                 rtnl_groups_list[i].family == family))
+        {
+            return rtnl_groups_list[i].group;
+        }
+    }
+
+    return 0;
+}
+
+static unsigned int rtnl_groups_kinds(unsigned int groups)
+{
+    unsigned int kinds = 0;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(rtnl_groups_list); i++)
+    {
+        if (groups & rtnl_groups_list[i].group)
+            kinds |= RTNL_KIND_BIT(rtnl_groups_list[i].kind);
+    }
+
+    return kinds;
+}
+
+static void rtnl_summary_route(rtnl_event_t *ev, int type, int is_changed)
+{
+    rtnl_summary_key_t key;
+    rtnl_summary_t *sum;
+    int is_new;
+
+    rtnl_decode(ev, rtnl_summary_need);
+
+    memset(&key, 0, sizeof(key));
+    key.ns = ev->ns;
+    key.oif = ev->has & RTNL_HAS_OIF ? ev->oif : 0;
+    key.table = ev->table;
+    key.family = ev->family;
+    key.gateway_len = ev->gateway.len > sizeof(key.gateway) ?
+        sizeof(key.gateway) : ev->gateway.len;
+    memcpy(key.gateway, ev->gateway.data, key.gateway_len);
+
+    sum = rtnl_summary_get(&key, &is_new);
+
+    /* the link may be gone when the summary is sent */
+    if (is_new && key.oif)
+    {
+        snprintf(sum->ifname, sizeof(sum->ifname), "%s",
+                rtnl_ifname_get(key.ns, key.oif));
+    }
+
+    if (type == RTM_DELROUTE)
+        sum->removed++;
+    else if (is_changed)
+        sum->changed++;
+    else
+        sum->added++;
+
+    if (!poll_timer_pending(&rtnl_summary_timer))
+        poll_timer_add(&rtnl_summary_timer, RTNL_SUMMARY_DELAY);
+}
+
+static void rtnl_summary_send(rtnl_summary_t *sum)
+{
+    char netns[16], table[16], gateway[INET6_ADDRSTRLEN] = "";
+    char added[16], changed[16], removed[16];
+    key_value_t vars[] =
+    {
+        { .key = NL_TYPE, .value = "ROUTE" },
+        { .key = NL_EVENT, .value = RTNL_SUMMARY_EVENT },
+        { .key = NL_NETNS, .value = rtnl_netns_name(sum->key.ns, netns,
+                sizeof(netns)) },
+        { .key = NL_FAMILY, .value = ifa_family_name_get(sum->key.family) },
+        { .key = NL_TABLE, .value = rt_table_name(sum->key.table, table,
+                sizeof(table)) },
+        { .key = NL_GATEWAY, .value = gateway },
+        { .key = NL_OIF, .value = sum->ifname },
+        { .key = NL_ADDED, .value = added },
+        { .key = NL_CHANGED, .value = changed },
+        { .key = NL_REMOVED, .value = removed },
+    };
+    int i;
+
+    if (sum->key.gateway_len)
+    {
+        inet_ntop(sum->key.family, sum->key.gateway, gateway,
+                sizeof(gateway));
+    }
+
+    snprintf(added, sizeof(added), "%u", sum->added);
+    snprintf(changed, sizeof(changed), "%u", sum->changed);
+    snprintf(removed, sizeof(removed), "%u", sum->removed);
+
+    for (i = 0; i < ARRAY_SIZE(vars) - 1; i++)
+        vars[i].next = &vars[i + 1];
+
+    event_nlmsg_send(vars, sum->hash);
+}
+
+static void on_summary_timer(poll_timer_t *timer, void *arg)
+{
+    rtnl_summary_flush(rtnl_summary_send);
+}
+
+static void rtnl_msg_event(struct nlmsghdr *msg, int mode, int ns)
+{
+    unsigned char key[RTNL_KEY_MAX];
+    int key_len, ifindex = 0;
+    int link[2];
+    rtnl_obj_t *obj;
+    char *event_name;
+    rtnl_var_t vars[RTNL_VARS_MAX];
+    struct nlmsghdr *old_msg = NULL;
+    rtnl_event_t ev, old;
+    unsigned int group;
+    key_value_t *kv;
+
+    event_name = event_name_get(msg->nlmsg_type);
+
+    /* not supported RTNETLINK type */
+    if (!event_name)
+        return;
+
+    /* no rule is interested, it may come before the group was left */
+    if (!(rtnl_groups & (group = rtnl_msg_group(msg))))
+        return;
+
+    if (rtnl_parse(msg, &ev, rtnl_need[RTNL_KIND_INDEX(msg->nlmsg_type)]))
+        return;
+
+    ev.ns = ns;
+    key_len = rtnl_obj_key(msg, ns, key, &ifindex);
+
+    if (mode != RTNL_REPLAY)
+    {
+        if (rtnl_is_del(msg->nlmsg_type))
+        {
+            rtnl_state_del(key, key_len);
+
+            if (msg->nlmsg_type == RTM_DELLINK)
+                rtnl_state_del_ifindex(ns, ifindex);
+        }
+        else
+        {
+            obj = rtnl_state_get(key, key_len);
+
+            if (mode == RTNL_SYNC && obj && !rtnl_obj_changed(obj, &ev))
+            {
+                obj->gen = rtnl_state_gen();
+                return;
+            }
+
+            /* the kind is dumped again when one more family is joined */
+            if (mode == RTNL_DUMP && obj)
+                mode = RTNL_SEED;
+
+            old_msg = rtnl_state_set(key, key_len, ns, ifindex,
+                    rtnl_msg_compact(msg));
+        }
+
+        if (mode == RTNL_SEED)
+        {
+            free(old_msg);
+            return;
+        }
+
+        if (mode == RTNL_SYNC)
+            rtnl_stats.recovered++;
+        else if (mode == RTNL_DUMP)
+            event_name = dump_name_get(msg->nlmsg_type);
+    }
+
+    if ((rtnl_summary_groups & group) && mode != RTNL_DUMP)
+        rtnl_summary_route(&ev, msg->nlmsg_type, old_msg != NULL);
+
+    /* the rules may want the summary of the routes only */
+    if (!(rtnl_event_groups & group))
+    {
+        free(old_msg);
+        return;
+    }
+
+    /* the previous state is rendered for OLD_* variables */
+    if (old_msg && !rtnl_parse(old_msg, &old, 0))
+    {
+        old.ns = ns;
+        kv = rtnl_vars_set(vars, &ev, &old, msg->nlmsg_type, event_name);
+    }
+    else
+    {
+        kv = rtnl_vars_set(vars, &ev, NULL, msg->nlmsg_type, event_name);
+    }
+
+    /* events of the interface are kept in order, routes are independent */
+    if (RTNL_KIND(msg->nlmsg_type) == RTM_NEWROUTE)
+    {
+        event_nlmsg_send(kv, mem_hash(key, key_len));
+    }
+    else
+    {
+        link[0] = ns;
+        link[1] = ifindex;
+        event_nlmsg_send(kv, mem_hash(link, sizeof(link)));
+    }
+
+    free(old_msg);
+}
+
+static void rtnl_ifname_update(struct nlmsghdr *msg, int ns)
+{
+    struct ifinfomsg *ifi = (struct ifinfomsg *)NLMSG_DATA(msg);
+    struct rtattr *tb_attrs[IFLA_MAX + 1];
+
+    rt_attrs_parse(tb_attrs, IFLA_MAX, IFLA_RTA(ifi), IFLA_PAYLOAD(msg));
+
+    if (tb_attrs[IFLA_IFNAME])
+        rtnl_ifname_set(ns, ifi->ifi_index, RTA_DATA(tb_attrs[IFLA_IFNAME]));
+}
+
+/*
+ * Interface names are kept from the link messages, the new name is known
+ * before the event is sent and DELLINK event still has the old one.
+ */
+static void rtnl_msg_handle(struct nlmsghdr *msg, int mode, int ns)
+{
+    if (msg->nlmsg_type == RTM_NEWLINK)
+        rtnl_ifname_update(msg, ns);
+
+    rtnl_msg_event(msg, mode, ns);
+
+    if (msg->nlmsg_type == RTM_DELLINK)
+    {
+        rtnl_ifname_del(ns,
+                ((struct ifinfomsg *)NLMSG_DATA(msg))->ifi_index);
+    }
+}
+
+static void rtnl_handle(nl_sock_t *nl_sock, void *buf, int len, int nsid)
+{
+    rtnl_ns_t *ns = (rtnl_ns_t *)nl_sock->obj;
+    int id = nsid == NL_NSID_NONE ? ns->id : RTNL_NS_NSID + nsid;
+    struct nlmsghdr *msg;
+
+    for_each_nlmsg(buf, msg, len)
+        rtnl_msg_handle(msg, RTNL_NOTIFY, id);
+}
+
+static void rtnl_dump_handle(struct nlmsghdr *msg, void *arg)
+{
+    int *dump = (int *)arg;
+
+    rtnl_msg_handle(msg, dump[0], dump[1]);
+}
+
+/* object was removed while the events were lost */
+static void rtnl_obj_lost(rtnl_obj_t *obj)
+{
+    obj->msg->nlmsg_type++;
+    rtnl_stats.recovered++;
+
+    rtnl_msg_handle(obj->msg, RTNL_REPLAY, obj->ns);
+}
+
+/*
+ * Dumps all the objects of the namespace and compares them with the known
+ * state, in RTNL_SYNC mode the events are sent for the new, changed and
+ * removed objects. The dumps of all the kinds run at once.
+ */
+static int rtnl_sync(rtnl_ns_t *ns, int mode, unsigned int kinds)
+{
+    static const int dumps[] =
+    {
+        RTM_GETLINK,
+        RTM_GETADDR,
+        RTM_GETNEIGH,
+        RTM_GETROUTE,
+    };
+    unsigned int gen = rtnl_state_gen_next();
+    int types[ARRAY_SIZE(dumps)];
+    int dump[2] = { mode, ns->id };
+    int i, count = 0, err;
+
+    for (i = 0; i < ARRAY_SIZE(dumps); i++)
+    {
+        if (kinds & RTNL_KIND_BIT(dumps[i]))
+            types[count++] = dumps[i];
+    }
+
+    if (ns->fd >= 0 && netns_enter(ns->fd))
+        return -1;
+
+    err = nl_dump(NETLINK_ROUTE, types, count, AF_UNSPEC, rtnl_dump_handle,
+            dump);
+
+    /* removed objects can't be trusted after a failed dump */
+    if (mode == RTNL_SYNC && !err)
+        rtnl_state_sweep(gen, ns->id, kinds, rtnl_obj_lost);
+
+    if (ns->fd >= 0)
+        netns_enter(-1);
+
+    return err;
+}
+
+static int rtnl_sync_all(int mode, unsigned int kinds)
+{
+    rtnl_ns_t *ns;
+    int err = 0;
+
+    for (ns = rtnl_ns_list; ns; ns = ns->next)
+    {
+        if (rtnl_sync(ns, mode, kinds))
+            err = -1;
+    }
+
+    return err;
+}
+
+static int rtnl_obj_is_nsid(rtnl_obj_t *obj, void *arg)
+{
+    return obj->ns >= RTNL_NS_NSID;
+}
+
+static void rtnl_lost(nl_sock_t *nl_sock)
+{
+    rtnl_ns_t *ns = (rtnl_ns_t *)nl_sock->obj;
+    unsigned long recovered = rtnl_stats.recovered;
+
+    rtnl_stats.resyncs++;
+
+    nlevtd_log(LOG_WARNING, "RT Netlink events were lost, resyncing ...\n");
+
+    if (rtnl_sync(ns, RTNL_SYNC, rtnl_groups_kinds(rtnl_sock_groups)))
+        nlevtd_log(LOG_ERR, "Can't resync RT Netlink state\n");
+
+    /*
+     * namespaces seen by nsid can't be dumped, their state may be stale now,
+     * so it is forgotten and built again from the next events
+     */
+    if (nl_sock->ctrls)
+    {
+        rtnl_state_remove(rtnl_obj_is_nsid, NULL, NULL);
+        rtnl_ifname_del_ns_from(RTNL_NS_NSID);
+    }
+
+    nlevtd_log(LOG_INFO, "RT Netlink resync recovered %lu events\n",
+            rtnl_stats.recovered - recovered);
+}
+
+static rtnl_ns_t *rtnl_ns_add(char *name)
+{
+    rtnl_ns_t **pns, *ns;
+
+    for (pns = &rtnl_ns_list; *pns; pns = &(*pns)->next)
+    {
+        if ((*pns)->name && !strcmp((*pns)->name, name))
+            return NULL;
+    }
+
+    ns = (rtnl_ns_t *)malloc(sizeof(rtnl_ns_t));
+    memset(ns, 0, sizeof(rtnl_ns_t));
+
+    ns->id = ++rtnl_ns_count;
+    ns->name = str_clone(name);
+    ns->fd = -1;
+
+    *pns = ns;
+    return ns;
+}
+
+/* adds the named namespace to be served, should be called before init */
+int rtnl_netns_add(char *name)
+{
+    rtnl_ns_add(name);
+    return 0;
+}
+
+static void rtnl_netns_add_all(void)
+{
+    struct dirent *dirent;
+    DIR *dir;
+
+    if (!(dir = opendir(NETNS_RUN_DIR)))
+        return;
+
+    while ((dirent = readdir(dir)))
+    {
+        if (dirent->d_name[0] != '.')
+            rtnl_netns_add(dirent->d_name);
+    }
+
+    closedir(dir);
+}
+
+static void rtnl_ns_free(rtnl_ns_t *ns)
+{
+    nl_sock_free(ns->sock);
+
+    if (ns->fd >= 0)
+        close(ns->fd);
+
+    free(ns->name);
+    free(ns);
+}
+
+static int rtnl_ns_open(rtnl_ns_t *ns)
+{
+    if (ns->name)
+    {
+        if ((ns->fd = netns_open(ns->name)) < 0 || netns_enter(ns->fd))
+            return -1;
+    }
+
+    /* the groups are joined when the rules are loaded */
+    ns->sock = nl_sock_create(NETLINK_ROUTE, 0);
+
+    if (ns->name)
+        netns_enter(-1);
+
+    if (!ns->sock)
+        return -1;
+
+    if (!ns->name && rtnl_all_nsid)
+        nl_sock_listen_all_nsid(ns->sock);
+
+    ns->sock->obj = ns;
+    nl_sock_groups_set(ns->sock, rtnl_sock_groups);
+
+    nl_sock_rcvbuf_set(ns->sock, rtnl_rcvbuf);
+    nl_sock_register_cb(ns->sock, rtnl_handle);
+    nl_sock_register_lost_cb(ns->sock, rtnl_lost);
+
+    return 0;
+}
+
+static void rtnl_filter_update(unsigned int kinds);
+
+static int rtnl_obj_ns_match(rtnl_obj_t *obj, void *arg)
+{
+    return obj->ns == *(int *)arg;
+}
+
+static void rtnl_ns_unlink(rtnl_ns_t *ns)
+{
+    rtnl_ns_t **pns;
+
+    for (pns = &rtnl_ns_list; *pns != ns; pns = &(*pns)->next)
+        ;
+
+    *pns = ns->next;
+}
+
+/* stops serving the namespace, its objects are forgotten without the events */
+static void rtnl_ns_remove(rtnl_ns_t *ns)
+{
+    rtnl_ns_unlink(ns);
+
+    nlevtd_log(LOG_INFO, "Network namespace %s is removed\n", ns->name);
+
+    rtnl_state_remove(rtnl_obj_ns_match, &ns->id, NULL);
+    rtnl_ifname_del_ns(ns->id);
+
+    /* the socket may have the datagrams queued for the handlers */
+    nl_sock_destroy(ns->sock);
+    ns->sock = NULL;
+
+    rtnl_ns_free(ns);
+}
+
+/*
+ * Syncs the served named namespaces with the NETNS_RUN_DIR folder. The one
+ * which file was removed or now refers to another namespace is dropped, the
+ * sockets are opened in the new ones.
+ */
+static void rtnl_netns_scan(void)
+{
+    rtnl_ns_t *ns, *next;
+    struct dirent *dirent;
+    DIR *dir;
+    int failed = 0;
+
+    for (ns = rtnl_ns_list; ns; ns = next)
+    {
+        next = ns->next;
+
+        if (ns->name && !netns_is_named(ns->fd, ns->name))
+            rtnl_ns_remove(ns);
+    }
+
+    if (!(dir = opendir(NETNS_RUN_DIR)))
+        return;
+
+    while ((dirent = readdir(dir)))
+    {
+        if (dirent->d_name[0] == '.' || !(ns = rtnl_ns_add(dirent->d_name)))
+            continue;
+
+        if (rtnl_ns_open(ns))
+        {
+            rtnl_ns_unlink(ns);
+            rtnl_ns_free(ns);
+            failed = 1;
+            continue;
+        }
+
+        nlevtd_log(LOG_INFO, "Network namespace %s is added\n", ns->name);
+
+        if (rtnl_sock_groups && rtnl_sync(ns, rtnl_dump_events ? RTNL_DUMP :
+                    RTNL_SEED, rtnl_groups_kinds(rtnl_sock_groups)))
+        {
+            nlevtd_log(LOG_ERR, "Can't dump RT Netlink state\n");
+        }
+    }
+
+    closedir(dir);
+
+    rtnl_filter_update(rtnl_groups_kinds(rtnl_sock_groups));
+
+    if (failed && rtnl_netns_retries++ < RTNL_NETNS_SCAN_RETRIES)
+        poll_timer_add(&rtnl_netns_timer, RTNL_NETNS_SCAN_RETRY);
+}
+
+static void on_netns_timer(poll_timer_t *timer, void *arg)
+{
+    rtnl_netns_scan();
+}
+
+static void on_netns_changed(struct inotify_event *e, void *arg)
+{
+    rtnl_netns_retries = 0;
+    poll_timer_add(&rtnl_netns_timer, RTNL_NETNS_SCAN_DELAY);
+}
+
+/* the named namespaces are added and removed at runtime */
+static void rtnl_netns_watch(void)
+{
+    /* the same as ip netns does, the folder may not exist yet */
+    mkdir(NETNS_RUN_DIR, 0755);
+
+    poll_timer_init(&rtnl_netns_timer, on_netns_timer, NULL);
+    fsnotify_register_handler(NETNS_RUN_DIR, IN_CREATE | IN_DELETE,
+            on_netns_changed, NULL);
+}
+
+static void rtnl_handler_init(void)
+{
+    rtnl_ns_t **pns, *ns;
+
+    poll_timer_init(&rtnl_summary_timer, on_summary_timer, NULL);
+    rtnl_attr_fields_init();
+    rtnl_summary_need = rtnl_fields_mask(RTM_NEWROUTE, rtnl_summary_keys);
+
+    if (rtnl_netns_all)
+        rtnl_netns_add_all();
+
+    if ((rtnl_ns_list || rtnl_netns_all) && netns_init())
+        nlevtd_log(LOG_ERR, "Network namespaces can't be served\n");
+    else if (rtnl_netns_all)
+        rtnl_netns_watch();
+
+    /* own namespace goes first */
+    ns = (rtnl_ns_t *)malloc(sizeof(rtnl_ns_t));
+    memset(ns, 0, sizeof(rtnl_ns_t));
+    ns->fd = -1;
+    ns->next = rtnl_ns_list;
+    rtnl_ns_list = ns;
+
+    for (pns = &rtnl_ns_list; (ns = *pns); )
+    {
+        if (rtnl_ns_open(ns))
+        {
+            nlevtd_log(LOG_ERR, "Can't listen RT Netlink in %s namespace\n",
+                    ns->name ? ns->name : "own");
+
+            *pns = ns->next;
+            rtnl_ns_free(ns);
+            continue;
+        }
+
+        pns = &ns->next;
+    }
+}
+
+/* template of the event, only the family of the values is known in advance */
+static key_value_t *rtnl_event_tmpl(int type, char *event_name, int family)
+{
+    key_value_t *tmpl = NULL;
+    const rtnl_field_t *fields;
+    int i, count = rtnl_fields_get(type, &fields);
+
+    /* the previous state comes with the objects which are not deleted */
+    for (i = count - 1; i >= 0 && !rtnl_is_del(type); i--)
+    {
+        if (fields[i].old_key)
+            tmpl = key_value_add(tmpl, fields[i].old_key, NULL);
+    }
+
+    for (i = count - 1; i >= 0; i--)
+    {
+        if (!strcmp(fields[i].key, NL_FAMILY) && family != AF_UNSPEC)
+            tmpl = key_value_add(tmpl, NL_FAMILY, ifa_family_name_get(family));
+        else
+            tmpl = key_value_add(tmpl, fields[i].key, NULL);
+    }
+
+    tmpl = key_value_add(tmpl, NL_EVENT, event_name);
+    tmpl = key_value_add(tmpl, NL_TYPE, "ROUTE");
+
+    return tmpl;
+}
+
+static key_value_t *rtnl_summary_tmpl(int family)
+{
+    key_value_t *tmpl = NULL;
+
+    tmpl = key_value_add(tmpl, NL_REMOVED, NULL);
+    tmpl = key_value_add(tmpl, NL_CHANGED, NULL);
+    tmpl = key_value_add(tmpl, NL_ADDED, NULL);
+    tmpl = key_value_add(tmpl, NL_OIF, NULL);
+    tmpl = key_value_add(tmpl, NL_GATEWAY, NULL);
+    tmpl = key_value_add(tmpl, NL_TABLE, NULL);
+    tmpl = key_value_add(tmpl, NL_FAMILY, ifa_family_name_get(family));
+    tmpl = key_value_add(tmpl, NL_NETNS, NULL);
+    tmpl = key_value_add(tmpl, NL_EVENT, RTNL_SUMMARY_EVENT);
+    tmpl = key_value_add(tmpl, NL_TYPE, "ROUTE");
+
+    return tmpl;
+}
+
+static int rtnl_summary_is_wanted(int family)
+{
+    key_value_t *tmpl = rtnl_summary_tmpl(family);
+    int wanted;
+
+    wanted = event_rules_may_match(tmpl, 0);
+    key_value_free_all(tmpl);
+
+    return wanted;
+}
+
+static int rtnl_event_is_wanted(int type, char *event_name, int family)
+{
+    key_value_t *tmpl = rtnl_event_tmpl(type, event_name, family);
+    int wanted;
+
+    wanted = event_rules_may_match(tmpl, 0);
+    key_value_free_all(tmpl);
+
+    return wanted;
+}
+
+/*
+ * Fields of the kind which the rules that may match its NEW, DEL or DUMP
+ * events look at. Other attributes are decoded only if a program is run.
+ */
+static unsigned int rtnl_kind_need(int kind)
+{
+    char *event_names[] =
+    {
+        event_name_get(kind),
+        event_name_get(kind + 1),
+        dump_name_get(kind),
+    };
+    int types[] = { kind, kind + 1, kind };
+    const rtnl_field_t *fields;
+    int i, j, count = rtnl_fields_get(kind, &fields);
+    unsigned int need = 0;
+    key_value_t *tmpl;
+
+    if (events_dump)
+        return ~0u;
+
+    for (j = 0; j < ARRAY_SIZE(event_names); j++)
+    {
+        tmpl = rtnl_event_tmpl(types[j], event_names[j], AF_UNSPEC);
+
+        for (i = 0; i < count; i++)
+        {
+            if (fields[i].attr && event_rules_use_key(tmpl, fields[i].key))
+                need |= 1u << i;
+        }
+
+        key_value_free_all(tmpl);
+    }
+
+    return need;
+}
+
+/*
+ * Checks if the rules may match NEW, DEL or DUMP event of the object kind and
+ * the address family.
+ */
+static int rtnl_kind_is_wanted(int kind, int family)
+{
+    if (rtnl_event_is_wanted(kind, event_name_get(kind), family) ||
+            rtnl_event_is_wanted(kind + 1, event_name_get(kind + 1), family))
+    {
+        return 1;
+    }
+
+    return rtnl_dump_events && rtnl_event_is_wanted(kind, dump_name_get(kind),
+            family);
+}
+
+/*
+ * Kernel drops the messages of the kinds which no rule can match, NEW and
+ * DEL messages are passed both to keep the state of the kind consistent.
+ */
+static void rtnl_filter_update(unsigned int kinds)
+{
+    static const int types[] =
+    {
+        RTM_NEWLINK, RTM_DELLINK,
+        RTM_NEWADDR, RTM_DELADDR,
+        RTM_NEWROUTE, RTM_DELROUTE,
+        RTM_NEWNEIGH, RTM_DELNEIGH,
+    };
+    bpf_prog_t prog = {};
+    rtnl_ns_t *ns;
+    int i;
+
+    if (kinds == RTNL_KINDS_ALL)
+    {
+        for (ns = rtnl_ns_list; ns; ns = ns->next)
+            bpf_prog_detach(ns->sock->sock);
+        return;
+    }
+
+    /* nlmsg_type, loaded in network byte order */
+    bpf_emit(&prog, BPF_LD | BPF_H | BPF_ABS, 0, 0,
+            offsetof(struct nlmsghdr, nlmsg_type));
+
+    for (i = 0; i < ARRAY_SIZE(types); i++)
+    {
+        if (!(kinds & RTNL_KIND_BIT(types[i])))
+            continue;
+
+        bpf_emit(&prog, BPF_JMP | BPF_JEQ | BPF_K, 0, 1, htons(types[i]));
+        bpf_emit(&prog, BPF_RET | BPF_K, 0, 0, BPF_ACCEPT);
+    }
+
+    bpf_emit(&prog, BPF_RET | BPF_K, 0, 0, BPF_REJECT);
+
+    for (ns = rtnl_ns_list; ns; ns = ns->next)
+        bpf_prog_attach(ns->sock->sock, &prog);
+
+    bpf_prog_free(&prog);
+}
+
+static int rtnl_obj_group_match(rtnl_obj_t *obj, void *arg)
+{
+    return rtnl_msg_group(obj->msg) & *(unsigned int *)arg;
+}
+
+/*
+ * Joins only the multicast groups of the objects which can be matched by the
+ * rules, so the kernel doesn't queue the other messages at all.
+ */
+static void rtnl_rules_changed(void)
+{
+    unsigned int groups, sock_groups, new_groups, old_groups;
+    unsigned int event_groups = 0, summary_groups = 0;
+    rtnl_ns_t *ns;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(rtnl_groups_list); i++)
+    {
+        if (events_dump || rtnl_kind_is_wanted(rtnl_groups_list[i].kind,
+                    rtnl_groups_list[i].family))
+        {
+            event_groups |= rtnl_groups_list[i].group;
+        }
+
+        if (rtnl_groups_list[i].kind == RTM_NEWROUTE && (events_dump ||
+                    rtnl_summary_is_wanted(rtnl_groups_list[i].family)))
+        {
+            summary_groups |= rtnl_groups_list[i].group;
+        }
+    }
+
+    groups = event_groups | summary_groups;
+    rtnl_event_groups = event_groups;
+    rtnl_summary_groups = summary_groups;
+
+    for (i = 0; i < RTNL_KINDS; i++)
+        rtnl_need[i] = rtnl_kind_need(RTM_NEWLINK + (i << 2));
+
+    /* events of the other kinds need the names of the interfaces */
+    sock_groups = groups ? groups | RTMGRP_LINK : 0;
+
+    /* links followed for the names only have no state to sync with */
+    new_groups = (groups & ~rtnl_groups) | (sock_groups & ~rtnl_sock_groups);
+    old_groups = rtnl_groups & ~groups;
+
+    rtnl_state_remove(rtnl_obj_group_match, &old_groups, NULL);
+    rtnl_groups = groups;
+    rtnl_sock_groups = sock_groups;
+
+    if (!sock_groups)
+        rtnl_ifname_del_ns(-1);
+
+    for (ns = rtnl_ns_list; ns; ns = ns->next)
+        nl_sock_groups_set(ns->sock, sock_groups);
+
+    rtnl_filter_update(rtnl_groups_kinds(sock_groups));
+
+    /*
+     * Known state is needed to find out what was missed on events loss, the
+     * objects which exist already may be reported by DUMP* events.
+     */
+    if (new_groups && rtnl_sync_all(rtnl_dump_events ? RTNL_DUMP : RTNL_SEED,
+                rtnl_groups_kinds(new_groups)))
+    {
+        nlevtd_log(LOG_ERR, "Can't dump RT Netlink state\n");
+    }
+
+    nlevtd_log(LOG_DEBUG, "RT Netlink state: %u objects\n",
+            rtnl_state_count());
+}
+
+static void rtnl_handler_cleanup(void)
+{
+    unsigned long overruns = 0;
+    rtnl_ns_t *ns;
+
+    for (ns = rtnl_ns_list; ns; ns = ns->next)
+        overruns += ns->sock->rx_overruns;
+
+    nlevtd_log(LOG_INFO, "RT Netlink: %lu overruns, %lu resyncs, %lu "
+            "recovered events\n", overruns, rtnl_stats.resyncs,
+            rtnl_stats.recovered);
+
+    while ((ns = rtnl_ns_list))
+    {
+        rtnl_ns_list = ns->next;
+        rtnl_ns_free(ns);
+    }
+
+    poll_timer_del(&rtnl_summary_timer);
+    rtnl_summary_flush(NULL);
 
-    key_value_free_all(kv_link);
-    key_value_free_all(kv_addr);
-    key_value_free_all(kv_neigh);
-    key_value_free_all(kv_route);
+    netns_cleanup();
+    rtnl_state_cleanup();
 }
 
 nl_handler_t rtnl_handler_ops = {
     .do_init = rtnl_handler_init,
     .do_cleanup = rtnl_handler_cleanup,
+    .do_rules_changed = rtnl_rules_changed,
 };
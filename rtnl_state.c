@@ -0,0 +1,406 @@
+/*
+ * Copyright (C) 2013 Vadim Kochan <vadim4j@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <net/if.h>
+
+#include "rtnl_state.h"
+#include "utils.h"
+
+#define STATE_SIZE_MIN 256
+#define IFNAMES_SIZE_MIN 64
+
+/* name of the interface in the namespace, kept from the link messages */
+typedef struct ifname
+{
+    struct ifname *next;
+    unsigned int hash;
+    int ns;
+    int ifindex;
+    char name[IFNAMSIZ];
+} ifname_t;
+
+static rtnl_obj_t **objs = NULL;
+static unsigned int objs_size = 0;
+static unsigned int objs_count = 0;
+static unsigned int state_gen = 0;
+
+static ifname_t **ifnames = NULL;
+static unsigned int ifnames_size = 0;
+static unsigned int ifnames_count = 0;
+
+static void state_resize(unsigned int size)
+{
+    rtnl_obj_t **new_objs = (rtnl_obj_t **)calloc(size, sizeof(rtnl_obj_t *));
+    rtnl_obj_t *obj, *next;
+    unsigned int i;
+
+    for (i = 0; i < objs_size; i++)
+    {
+        for (obj = objs[i]; obj; obj = next)
+        {
+            next = obj->next;
+            obj->next = new_objs[obj->hash & (size - 1)];
+            new_objs[obj->hash & (size - 1)] = obj;
+        }
+    }
+
+    free(objs);
+    objs = new_objs;
+    objs_size = size;
+}
+
+static rtnl_obj_t **state_lookup(void *key, int key_len, unsigned int hash)
+{
+    rtnl_obj_t **obj;
+
+    if (!objs)
+        return NULL;
+
+    for (obj = &objs[hash & (objs_size - 1)]; *obj; obj = &(*obj)->next)
+    {
+        if ((*obj)->hash == hash && (*obj)->key_len == key_len &&
+                !memcmp((*obj)->key, key, key_len))
+        {
+            return obj;
+        }
+    }
+
+    return NULL;
+}
+
+static void obj_free(rtnl_obj_t *obj)
+{
+    free(obj->msg);
+    free(obj);
+}
+
+rtnl_obj_t *rtnl_state_get(void *key, int key_len)
+{
+    rtnl_obj_t **obj = state_lookup(key, key_len, mem_hash(key, key_len));
+
+    return obj ? *obj : NULL;
+}
+
+/*
+ * Keeps the allocated message as the last known state of the object, returns
+ * the previous message which is freed by the caller.
+ */
+struct nlmsghdr *rtnl_state_set(void *key, int key_len, int ns, int ifindex,
+    struct nlmsghdr *msg)
+{
+    unsigned int hash = mem_hash(key, key_len);
+    struct nlmsghdr *old_msg = NULL;
+    rtnl_obj_t **pobj;
+    rtnl_obj_t *obj;
+
+    if (key_len > RTNL_KEY_MAX)
+        return NULL;
+
+    if ((pobj = state_lookup(key, key_len, hash)))
+    {
+        obj = *pobj;
+        old_msg = obj->msg;
+    }
+    else
+    {
+        if (objs_count >= objs_size)
+            state_resize(objs_size ? objs_size * 2 : STATE_SIZE_MIN);
+
+        obj = (rtnl_obj_t *)malloc(sizeof(rtnl_obj_t) + key_len);
+        obj->hash = hash;
+        obj->key_len = key_len;
+        memcpy(obj->key, key, key_len);
+
+        obj->next = objs[hash & (objs_size - 1)];
+        objs[hash & (objs_size - 1)] = obj;
+        objs_count++;
+    }
+
+    obj->msg = msg;
+    obj->ns = ns;
+    obj->ifindex = ifindex;
+    obj->gen = state_gen;
+
+    return old_msg;
+}
+
+void rtnl_state_del(void *key, int key_len)
+{
+    rtnl_obj_t **pobj = state_lookup(key, key_len, mem_hash(key, key_len));
+    rtnl_obj_t *obj;
+
+    if (!pobj)
+        return;
+
+    obj = *pobj;
+    *pobj = obj->next;
+    objs_count--;
+
+    obj_free(obj);
+}
+
+/* removes the objects matched by match, func is called before free */
+void rtnl_state_remove(int (*match)(rtnl_obj_t *obj, void *arg), void *arg,
+    void (*func)(rtnl_obj_t *obj))
+{
+    rtnl_obj_t **pobj, *obj;
+    unsigned int i;
+
+    for (i = 0; i < objs_size; i++)
+    {
+        pobj = &objs[i];
+
+        while ((obj = *pobj))
+        {
+            if (!match(obj, arg))
+            {
+                pobj = &obj->next;
+                continue;
+            }
+
+            *pobj = obj->next;
+            objs_count--;
+
+            if (func)
+                func(obj);
+
+            obj_free(obj);
+        }
+    }
+}
+
+static int ifindex_match(rtnl_obj_t *obj, void *arg)
+{
+    int *link = (int *)arg;
+
+    return obj->ns == link[0] && obj->ifindex == link[1];
+}
+
+/* objects which are removed by the kernel silently with the link */
+void rtnl_state_del_ifindex(int ns, int ifindex)
+{
+    int link[2] = { ns, ifindex };
+
+    rtnl_state_remove(ifindex_match, link, NULL);
+}
+
+unsigned int rtnl_state_gen_next(void)
+{
+    return ++state_gen;
+}
+
+unsigned int rtnl_state_gen(void)
+{
+    return state_gen;
+}
+
+typedef struct sweep_arg
+{
+    unsigned int gen;
+    int ns;
+    unsigned int kinds;
+} sweep_arg_t;
+
+static int sweep_match(rtnl_obj_t *obj, void *arg)
+{
+    sweep_arg_t *sweep = (sweep_arg_t *)arg;
+
+    return (sweep->kinds & (1u << obj->key[0])) && obj->ns == sweep->ns &&
+        obj->gen != sweep->gen;
+}
+
+/*
+ * Removes objects of the kinds in the namespace which were not seen since gen
+ * was started.
+ */
+void rtnl_state_sweep(unsigned int gen, int ns, unsigned int kinds,
+    void (*func)(rtnl_obj_t *obj))
+{
+    sweep_arg_t sweep = { .gen = gen, .ns = ns, .kinds = kinds };
+
+    rtnl_state_remove(sweep_match, &sweep, func);
+}
+
+static int kinds_match(rtnl_obj_t *obj, void *arg)
+{
+    return *(unsigned int *)arg & (1u << obj->key[0]);
+}
+
+void rtnl_state_del_kinds(unsigned int kinds)
+{
+    rtnl_state_remove(kinds_match, &kinds, NULL);
+}
+
+unsigned int rtnl_state_count(void)
+{
+    return objs_count;
+}
+
+static unsigned int ifname_hash(int ns, int ifindex)
+{
+    int link[2] = { ns, ifindex };
+
+    return mem_hash(link, sizeof(link));
+}
+
+static void ifnames_resize(unsigned int size)
+{
+    ifname_t **new_ifnames = (ifname_t **)calloc(size, sizeof(ifname_t *));
+    ifname_t *ifn, *next;
+    unsigned int i;
+
+    for (i = 0; i < ifnames_size; i++)
+    {
+        for (ifn = ifnames[i]; ifn; ifn = next)
+        {
+            next = ifn->next;
+            ifn->next = new_ifnames[ifn->hash & (size - 1)];
+            new_ifnames[ifn->hash & (size - 1)] = ifn;
+        }
+    }
+
+    free(ifnames);
+    ifnames = new_ifnames;
+    ifnames_size = size;
+}
+
+static ifname_t **ifname_lookup(int ns, int ifindex)
+{
+    unsigned int hash = ifname_hash(ns, ifindex);
+    ifname_t **ifn;
+
+    if (!ifnames)
+        return NULL;
+
+    for (ifn = &ifnames[hash & (ifnames_size - 1)]; *ifn; ifn = &(*ifn)->next)
+    {
+        if ((*ifn)->ns == ns && (*ifn)->ifindex == ifindex)
+            return ifn;
+    }
+
+    return NULL;
+}
+
+/* adds or renames the interface */
+void rtnl_ifname_set(int ns, int ifindex, char *name)
+{
+    ifname_t **pifn = ifname_lookup(ns, ifindex);
+    ifname_t *ifn;
+
+    if (pifn)
+    {
+        ifn = *pifn;
+    }
+    else
+    {
+        if (ifnames_count >= ifnames_size)
+            ifnames_resize(ifnames_size ? ifnames_size * 2 : IFNAMES_SIZE_MIN);
+
+        ifn = (ifname_t *)malloc(sizeof(ifname_t));
+        ifn->hash = ifname_hash(ns, ifindex);
+        ifn->ns = ns;
+        ifn->ifindex = ifindex;
+
+        ifn->next = ifnames[ifn->hash & (ifnames_size - 1)];
+        ifnames[ifn->hash & (ifnames_size - 1)] = ifn;
+        ifnames_count++;
+    }
+
+    snprintf(ifn->name, sizeof(ifn->name), "%s", name);
+}
+
+/* returns empty name if the interface is not known */
+char *rtnl_ifname_get(int ns, int ifindex)
+{
+    ifname_t **ifn = ifname_lookup(ns, ifindex);
+
+    return ifn ? (*ifn)->name : "";
+}
+
+void rtnl_ifname_del(int ns, int ifindex)
+{
+    ifname_t **pifn = ifname_lookup(ns, ifindex);
+    ifname_t *ifn;
+
+    if (!pifn)
+        return;
+
+    ifn = *pifn;
+    *pifn = ifn->next;
+    ifnames_count--;
+
+    free(ifn);
+}
+
+/* forgets the interfaces of the namespaces from ns to ns_last */
+static void ifnames_del_range(int ns, int ns_last)
+{
+    ifname_t **pifn, *ifn;
+    unsigned int i;
+
+    for (i = 0; i < ifnames_size; i++)
+    {
+        pifn = &ifnames[i];
+
+        while ((ifn = *pifn))
+        {
+            if (ifn->ns < ns || ifn->ns > ns_last)
+            {
+                pifn = &ifn->next;
+                continue;
+            }
+
+            *pifn = ifn->next;
+            ifnames_count--;
+            free(ifn);
+        }
+    }
+}
+
+/* forgets the interfaces of the namespace, ns < 0 matches all of them */
+void rtnl_ifname_del_ns(int ns)
+{
+    if (ns < 0)
+        ifnames_del_range(INT_MIN, INT_MAX);
+    else
+        ifnames_del_range(ns, ns);
+}
+
+/* forgets the interfaces of the namespaces from ns up */
+void rtnl_ifname_del_ns_from(int ns)
+{
+    ifnames_del_range(ns, INT_MAX);
+}
+
+void rtnl_state_cleanup(void)
+{
+    rtnl_state_del_kinds(~0u);
+
+    free(objs);
+    objs = NULL;
+    objs_size = objs_count = 0;
+
+    rtnl_ifname_del_ns(-1);
+
+    free(ifnames);
+    ifnames = NULL;
+    ifnames_size = 0;
+}
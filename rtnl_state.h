@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2013 Vadim Kochan <vadim4j@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _RTNL_STATE_H_
+#define _RTNL_STATE_H_
+
+#include <linux/netlink.h>
+
+#define RTNL_KEY_MAX 64
+
+/*
+ * Object kind is the first RTM_* type of the family (RTM_NEWLINK, ...) and
+ * goes as the first byte of the object key.
+ */
+#define RTNL_KIND(type) ((type) & ~3)
+#define RTNL_KIND_BIT(type) (1u << RTNL_KIND(type))
+
+/*
+ * Last known state of a kernel object (link, address, neighbour, route), the
+ * message keeps only the attributes the events are made of.
+ */
+typedef struct rtnl_obj
+{
+    struct rtnl_obj *next;
+    struct nlmsghdr *msg;
+    unsigned int hash;
+    unsigned int gen;
+    /* network namespace the object belongs to */
+    int ns;
+    int ifindex;
+    int key_len;
+    unsigned char key[];
+} rtnl_obj_t;
+
+rtnl_obj_t *rtnl_state_get(void *key, int key_len);
+struct nlmsghdr *rtnl_state_set(void *key, int key_len, int ns, int ifindex,
+    struct nlmsghdr *msg);
+void rtnl_state_del(void *key, int key_len);
+void rtnl_state_del_ifindex(int ns, int ifindex);
+unsigned int rtnl_state_gen_next(void);
+unsigned int rtnl_state_gen(void);
+void rtnl_state_sweep(unsigned int gen, int ns, unsigned int kinds,
+    void (*func)(rtnl_obj_t *obj));
+void rtnl_state_del_kinds(unsigned int kinds);
+void rtnl_state_remove(int (*match)(rtnl_obj_t *obj, void *arg), void *arg,
+    void (*func)(rtnl_obj_t *obj));
+unsigned int rtnl_state_count(void);
+
+void rtnl_ifname_set(int ns, int ifindex, char *name);
+char *rtnl_ifname_get(int ns, int ifindex);
+void rtnl_ifname_del(int ns, int ifindex);
+void rtnl_ifname_del_ns(int ns);
+void rtnl_ifname_del_ns_from(int ns);
+void rtnl_state_cleanup(void);
+
+#endif /* _RTNL_STATE_H_ */
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2013 Vadim Kochan <vadim4j@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "rtnl_summary.h"
+#include "utils.h"
+
+#define SUMMARY_SIZE 256
+
+static rtnl_summary_t *sums[SUMMARY_SIZE];
+static unsigned int sums_count = 0;
+
+/* finds or adds the summary of the key, is_new is set for the added one */
+rtnl_summary_t *rtnl_summary_get(rtnl_summary_key_t *key, int *is_new)
+{
+    unsigned int hash = mem_hash(key, sizeof(*key));
+    rtnl_summary_t **psum = &sums[hash & (SUMMARY_SIZE - 1)];
+    rtnl_summary_t *sum;
+
+    for (sum = *psum; sum; sum = sum->next)
+    {
+        if (sum->hash == hash && !memcmp(&sum->key, key, sizeof(*key)))
+        {
+            *is_new = 0;
+            return sum;
+        }
+    }
+
+    sum = (rtnl_summary_t *)calloc(1, sizeof(rtnl_summary_t));
+    sum->hash = hash;
+    sum->key = *key;
+    sum->next = *psum;
+    *psum = sum;
+    sums_count++;
+
+    *is_new = 1;
+    return sum;
+}
+
+/* passes each summary to func if it is given and removes them all */
+void rtnl_summary_flush(void (*func)(rtnl_summary_t *sum))
+{
+    rtnl_summary_t *sum, *next;
+    int i;
+
+    for (i = 0; i < SUMMARY_SIZE; i++)
+    {
+        for (sum = sums[i]; sum; sum = next)
+        {
+            next = sum->next;
+
+            if (func)
+                func(sum);
+
+            free(sum);
+        }
+
+        sums[i] = NULL;
+    }
+
+    sums_count = 0;
+}
+
+unsigned int rtnl_summary_count(void)
+{
+    return sums_count;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2013 Vadim Kochan <vadim4j@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _RTNL_SUMMARY_H_
+#define _RTNL_SUMMARY_H_
+
+#include <net/if.h>
+
+/* routes are summarized by the namespace, table, gateway and interface */
+typedef struct rtnl_summary_key
+{
+    int ns;
+    int oif;
+    unsigned int table;
+    unsigned char family;
+    unsigned char gateway_len;
+    unsigned char gateway[16];
+} rtnl_summary_key_t;
+
+/* count of the route changes of the key since the last flush */
+typedef struct rtnl_summary
+{
+    struct rtnl_summary *next;
+    unsigned int hash;
+    rtnl_summary_key_t key;
+    char ifname[IFNAMSIZ];
+    unsigned int added;
+    unsigned int changed;
+    unsigned int removed;
+} rtnl_summary_t;
+
+rtnl_summary_t *rtnl_summary_get(rtnl_summary_key_t *key, int *is_new);
+void rtnl_summary_flush(void (*func)(rtnl_summary_t *sum));
+unsigned int rtnl_summary_count(void);
+
+#endif /* _RTNL_SUMMARY_H_ */
@@ -1,9 +1,9 @@
 #!/bin/sh
 
-if [ "$POWER_SUPPLY_ONLINE" = "1" ]; then
-    echo "$POWER_SUPPLY_NAME is connected"
+if [ "$ATTR_status" = "Discharging" ]; then
+    echo "$POWER_SUPPLY_NAME is discharging, $ATTR_capacity% left"
 else
-    echo "$POWER_SUPPLY_NAME is disconnected"
+    echo "$POWER_SUPPLY_NAME is $ATTR_status, $ATTR_capacity%"
 fi
 
 echo ""
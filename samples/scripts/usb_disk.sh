@@ -1,9 +1,13 @@
 #!/bin/sh
 
+# ATTR_size is in 512 bytes sectors
+SIZE_MB=$((${ATTR_size:-0} / 2048))
+
 if [ "$ACTION" = "add" ]; then
     echo "Added USB storage device /dev/$DEVNAME"
 else
     echo "Removed USB storage device /dev/$DEVNAME"
 fi
 
+echo "Device: $ATTR_device_vendor $ATTR_device_model, ${SIZE_MB}MB, removable: $ATTR_removable"
 echo ""
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2013 Vadim Kochan <vadim4j@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "udev_attr.h"
+#include "utils.h"
+
+#define UDEV_ATTR_SIZE 256
+/* the cache is dropped at once when it is full */
+#define UDEV_ATTR_DEVS_MAX 4096
+/* sysfs attribute is one page at most */
+#define UDEV_ATTR_VALUE_SIZE 4096
+#define UDEV_ATTR_SYSFS "/sys"
+
+static udev_attr_dev_t *devs[UDEV_ATTR_SIZE];
+static unsigned int devs_count = 0;
+
+static udev_attr_dev_t **udev_attr_dev_find(char *devpath, unsigned int hash)
+{
+    udev_attr_dev_t **pdev = &devs[hash & (UDEV_ATTR_SIZE - 1)];
+
+    for (; *pdev; pdev = &(*pdev)->next)
+    {
+        if ((*pdev)->hash == hash && !strcmp((*pdev)->devpath, devpath))
+            break;
+    }
+
+    return pdev;
+}
+
+/* value without the trailing newline, "" if the attribute can't be read */
+static char *udev_attr_read(char *devpath, char *name)
+{
+    char path[UDEV_ATTR_VALUE_SIZE], *value;
+    int fd, len = -1;
+
+    snprintf(path, sizeof(path), UDEV_ATTR_SYSFS "%s/%s", devpath, name);
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) != -1)
+    {
+        len = read(fd, path, sizeof(path) - 1);
+        close(fd);
+    }
+
+    if (len < 0)
+        len = 0;
+
+    while (len && path[len - 1] == '\n')
+        len--;
+
+    value = (char *)malloc(len + 1);
+    memcpy(value, path, len);
+    value[len] = '\0';
+
+    return value;
+}
+
+/* attribute of the device, sysfs is read only for the first time */
+char *udev_attr_get(char *devpath, char *name)
+{
+    unsigned int hash = mem_hash(devpath, strlen(devpath));
+    udev_attr_dev_t **pdev = udev_attr_dev_find(devpath, hash);
+    udev_attr_dev_t *dev = *pdev;
+    key_value_t *kv;
+
+    if (!dev)
+    {
+        if (devs_count >= UDEV_ATTR_DEVS_MAX)
+        {
+            udev_attr_flush();
+            pdev = udev_attr_dev_find(devpath, hash);
+        }
+
+        dev = (udev_attr_dev_t *)calloc(1, sizeof(*dev) + strlen(devpath) + 1);
+        dev->hash = hash;
+        strcpy(dev->devpath, devpath);
+        *pdev = dev;
+        devs_count++;
+    }
+
+    for (kv = dev->attrs; kv; kv = kv->next)
+    {
+        if (!strcmp((char *)kv->key, name))
+            return (char *)kv->value;
+    }
+
+    dev->attrs = key_value_add(dev->attrs, strdup(name),
+            udev_attr_read(devpath, name));
+
+    return (char *)dev->attrs->value;
+}
+
+void udev_attr_invalidate(char *devpath)
+{
+    unsigned int hash = mem_hash(devpath, strlen(devpath));
+    udev_attr_dev_t **pdev = udev_attr_dev_find(devpath, hash);
+    udev_attr_dev_t *dev = *pdev;
+
+    if (!dev)
+        return;
+
+    *pdev = dev->next;
+    key_value_free_full(dev->attrs);
+    free(dev);
+    devs_count--;
+}
+
+void udev_attr_flush(void)
+{
+    udev_attr_dev_t *dev, *next;
+    int i;
+
+    for (i = 0; i < UDEV_ATTR_SIZE; i++)
+    {
+        for (dev = devs[i]; dev; dev = next)
+        {
+            next = dev->next;
+            key_value_free_full(dev->attrs);
+            free(dev);
+        }
+
+        devs[i] = NULL;
+    }
+
+    devs_count = 0;
+}
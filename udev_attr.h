@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2013 Vadim Kochan <vadim4j@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _UDEV_ATTR_H_
+#define _UDEV_ATTR_H_
+
+#include "key_value.h"
+
+/* sysfs attributes of the devices, kept until the device is changed */
+typedef struct udev_attr_dev
+{
+    struct udev_attr_dev *next;
+    unsigned int hash;
+    /* the keys are the names, the values are "" for missing attributes */
+    key_value_t *attrs;
+    char devpath[];
+} udev_attr_dev_t;
+
+char *udev_attr_get(char *devpath, char *name);
+void udev_attr_invalidate(char *devpath);
+void udev_attr_flush(void);
+
+#endif /* _UDEV_ATTR_H_ */
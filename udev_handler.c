@@ -15,90 +15,481 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
 
 #include "defs.h"
+#include "bpf.h"
 #include "nl_handler.h"
+#include "event.h"
+#include "uevent.h"
+#include "coldplug.h"
+#include "udev_attr.h"
+#include "utils.h"
+#include "log.h"
+
+/* multicast groups of the uevents sent by the kernel and by udevd */
+#define UDEV_GROUP_KERNEL 1
+#define UDEV_GROUP_MONITOR 2
+
+/* rule key of the sysfs attribute, ATTR{name} */
+#define UDEV_ATTR_PREFIX "ATTR{"
+
+/* DEVPATH length the socket filter looks for SUBSYSTEM after */
+#define UDEV_DEVPATH_SCAN 512
 
 static nl_sock_t *udev_sock = NULL;
 
-key_value_t kv_list = {.next = NULL, .key = NL_TYPE, .value = "UEVENT"};
+int udev_rcvbuf = NL_RCVBUF_UEVENT;
+int udev_monitor = 0;
+int udev_coldplug = COLDPLUG_NONE;
+
+/* subsystems the rules may match, the keys are the names */
+static key_value_t *udev_subsystems = NULL;
+
+/* ATTR{name} keys of the rules, the values are the attribute names */
+static key_value_t *udev_attrs = NULL;
+/* DEVPATH of the handled uevent, the attributes are rendered on use */
+static char *udev_attr_devpath;
 
-key_value_t *kv_set_next(key_value_t *kv, char *key, char *val)
+/* kobject actions, uevent header is ACTION@DEVPATH */
+static char *udev_actions[] =
 {
-    if (!kv)
+    "add",
+    "remove",
+    "change",
+    "move",
+    "online",
+    "offline",
+    "bind",
+    "unbind",
+};
+
+/* uevents are filtered by the kernel */
+static int udev_filtered = 0;
+
+static struct
+{
+    unsigned long long seqnum;
+    unsigned long gaps;
+    unsigned long missed;
+} udev_stats;
+
+/* uevents are handled one by one, the variables point into the buffer */
+static uevent_t udev_event;
+
+/*
+ * Kernel numbers all the uevents, the gap means that the events were lost.
+ * Though the uevents of the devices from other network namespaces are
+ * numbered too but not sent to us, so the gap is just a hint. The gaps are
+ * expected if the socket filter is attached. udevd handles the uevents in
+ * parallel, so the monitor messages are not checked.
+ */
+static void udev_seqnum_check(char *seqnum_str)
+{
+    unsigned long long seqnum = strtoull(seqnum_str, NULL, 10);
+
+    if (udev_stats.seqnum && seqnum > udev_stats.seqnum + 1 && !udev_filtered)
     {
-        kv = key_value_add(NULL, key, val);
+        udev_stats.gaps++;
+        udev_stats.missed += seqnum - udev_stats.seqnum - 1;
+
+        nlevtd_log(LOG_DEBUG, "Uevent SEQNUM gap: %llu -> %llu\n",
+                udev_stats.seqnum, seqnum);
     }
-    else
+
+    udev_stats.seqnum = seqnum;
+}
+
+static void udev_lost(nl_sock_t *nl_sock)
+{
+    nlevtd_log(LOG_WARNING, "Uevents were lost, they can't be recovered\n");
+}
+
+static char *udev_attr_render(key_value_t *kv)
+{
+    return udev_attr_get(udev_attr_devpath, (char *)kv->value);
+}
+
+static void udev_attrs_add(uevent_t *ev, char *devpath)
+{
+    char *action = uevent_get(ev, UEVENT_ACTION);
+    key_value_t *kv;
+
+    /* the attributes are read again after the device is changed */
+    if (!strcmp(action, "add") || !strcmp(action, "change"))
+        udev_attr_invalidate(devpath);
+    else if (!strcmp(action, "move"))
+        udev_attr_invalidate(uevent_get(ev, UEVENT_DEVPATH_OLD));
+
+    /* sysfs is not read for the uevents which can't match */
+    if (!event_rules_may_match(ev->vars, 1))
+        return;
+
+    udev_attr_devpath = devpath;
+
+    for (kv = udev_attrs; kv; kv = kv->next)
+        uevent_lazy_add(ev, (char *)kv->key, (char *)kv->value,
+                udev_attr_render);
+}
+
+static void udev_handle(nl_sock_t *nl_sock, void *buf, int len, int nsid)
+{
+    uevent_t *ev = &udev_event;
+    char *devpath;
+
+    /* receive buffer has a spare byte for the terminating NUL */
+    ((char *)buf)[len] = '\0';
+
+    if (!uevent_parse(ev, (char *)buf, len))
+        return;
+
+    if (ev->keys[UEVENT_SEQNUM] && !udev_monitor)
+        udev_seqnum_check(ev->keys[UEVENT_SEQNUM]);
+
+    devpath = uevent_get(ev, UEVENT_DEVPATH);
+
+    if (udev_attrs)
+        udev_attrs_add(ev, devpath);
+
+    /* events of the same device are kept in order */
+    event_nlmsg_send(ev->vars, mem_hash(devpath, strlen(devpath)));
+
+    /* sysfs folder is gone already, remove uevent gets the kept attributes */
+    if (udev_attrs && !strcmp(uevent_get(ev, UEVENT_ACTION), "remove"))
+        udev_attr_invalidate(devpath);
+}
+
+void udev_handler_init(void)
+{
+    /* the group is joined when the rules are loaded */
+    udev_sock = nl_sock_create(NETLINK_KOBJECT_UEVENT, 0);
+    nl_sock_rcvbuf_set(udev_sock, udev_rcvbuf);
+    nl_sock_register_cb(udev_sock, udev_handle);
+    nl_sock_register_lost_cb(udev_sock, udev_lost);
+}
+
+/* action is NULL if it is not known */
+static int udev_subsystem_may_match(char *action, char *subsystem)
+{
+    key_value_t kv_action = {.next = NULL, .key = "ACTION", .value = action};
+    key_value_t kv_subsystem = {.next = action ? &kv_action : NULL,
+        .key = "SUBSYSTEM", .value = subsystem};
+    key_value_t kv_tmpl = {.next = &kv_subsystem, .key = NL_TYPE,
+        .value = "UEVENT"};
+
+    return event_rules_may_match(&kv_tmpl, 1);
+}
+
+/* adds the subsystem if a rule may match it with one of the actions */
+static void udev_subsystem_check(char *subsystem, void *arg)
+{
+    char **actions = (char **)arg;
+    key_value_t *kv;
+    int may_match = 0;
+
+    if (subsystem[0] == '.')
+        return;
+
+    if (!actions)
+        may_match = udev_subsystem_may_match(NULL, subsystem);
+
+    for (; actions && *actions && !may_match; actions++)
+        may_match = udev_subsystem_may_match(*actions, subsystem);
+
+    if (!may_match)
+        return;
+
+    for (kv = udev_subsystems; kv; kv = kv->next)
     {
-        if (!kv->next)
-            kv->next = key_value_add(NULL, key, val);
+        if (!strcmp((char *)kv->key, subsystem))
+            return;
+    }
+
+    udev_subsystems = key_value_add(udev_subsystems, str_clone(subsystem),
+            NULL);
+}
+
+/*
+ * The words of the SUBSYSTEM patterns, they are all the subsystems the rules
+ * may match if the patterns are literal. actions is NULL terminated list or
+ * NULL if the action is not known.
+ */
+static void udev_subsystems_load(char **actions)
+{
+    key_value_free_full(udev_subsystems);
+    udev_subsystems = NULL;
 
-        kv = kv->next;
+    event_rules_words("SUBSYSTEM", udev_subsystem_check, actions);
+}
 
-        kv->key = key;
-        kv->value = val;
+/*
+ * udevd puts the hash of SUBSYSTEM into the monitor message header, so the
+ * messages of the other subsystems are dropped before the properties are
+ * looked at. Returns 0 if the rules don't limit the subsystem.
+ */
+static int udev_monitor_prog(bpf_prog_t *prog)
+{
+    key_value_t *kv;
+
+    /* rule without SUBSYSTEM or with any one matches the empty value too */
+    if (events_dump || !event_rules_literal("SUBSYSTEM") ||
+            udev_subsystem_may_match(NULL, ""))
+    {
+        return 0;
     }
 
-    return kv;
+    udev_subsystems_load(NULL);
+
+    bpf_emit(prog, BPF_LD | BPF_W | BPF_ABS, 0, 0,
+            offsetof(uevent_monitor_hdr_t, magic));
+    bpf_emit(prog, BPF_JMP | BPF_JEQ | BPF_K, 1, 0, UEVENT_MONITOR_MAGIC);
+    bpf_emit(prog, BPF_RET | BPF_K, 0, 0, BPF_REJECT);
+
+    bpf_emit(prog, BPF_LD | BPF_W | BPF_ABS, 0, 0,
+            offsetof(uevent_monitor_hdr_t, subsystem_hash));
+
+    for (kv = udev_subsystems; kv; kv = kv->next)
+    {
+        bpf_emit(prog, BPF_JMP | BPF_JEQ | BPF_K, 0, 1,
+                murmur_hash2(kv->key, strlen((char *)kv->key), 0));
+        bpf_emit(prog, BPF_RET | BPF_K, 0, 0, BPF_ACCEPT);
+    }
+
+    bpf_emit(prog, BPF_RET | BPF_K, 0, 0, BPF_REJECT);
+
+    return 1;
 }
 
-static void udev_handle(nl_sock_t *nl_sock, void *buf, int len)
+/*
+ * The kernel message is "ACTION@DEVPATH\0ACTION=..\0DEVPATH=..\0SUBSYSTEM=..",
+ * X holds the DEVPATH offset. The filter has no loops, so the end of DEVPATH
+ * is looked for byte by byte, then SUBSYSTEM is at 2 * (X + length) + 17.
+ * The messages of the other layout or with too long DEVPATH are accepted.
+ */
+static void udev_subsystem_prog(bpf_prog_t *prog)
 {
-    int i;
-    char *action, *path;
-    char *pos;
-    int keylen;
-    char *key, *val;
-    char *uevent = (char *)buf;
-    unsigned int bufpos = 0;
-    key_value_t *kv = &kv_list, *kv_tmp;
+    key_value_t *kv;
+    int i, len, compute = prog->len + UDEV_DEVPATH_SCAN * 4 + 1;
+
+    for (i = 1; i <= UDEV_DEVPATH_SCAN; i++)
+    {
+        bpf_emit(prog, BPF_LD | BPF_B | BPF_IND, 0, 0, i);
+        bpf_emit(prog, BPF_JMP | BPF_JEQ | BPF_K, 0, 2, 0);
+        bpf_emit(prog, BPF_LD | BPF_IMM, 0, 0, i);
+        bpf_emit(prog, BPF_JMP | BPF_JA, 0, 0, compute - prog->len - 1);
+    }
+
+    bpf_emit(prog, BPF_RET | BPF_K, 0, 0, BPF_ACCEPT);
+
+    bpf_emit(prog, BPF_ALU | BPF_ADD | BPF_X, 0, 0, 0);
+    bpf_emit(prog, BPF_ALU | BPF_MUL | BPF_K, 0, 0, 2);
+    bpf_emit(prog, BPF_ALU | BPF_ADD | BPF_K, 0, 0, 17);
+    bpf_emit(prog, BPF_MISC | BPF_TAX, 0, 0, 0);
 
-    uevent[len] = '\0';
-    bufpos = strlen(uevent) + 1;
+    bpf_emit_str_test(prog, BPF_IND, 0, "SUBSYSTEM=", strlen("SUBSYSTEM="), 1);
+    bpf_emit(prog, BPF_JMP | BPF_JA, 0, 0, 1);
+    bpf_emit(prog, BPF_RET | BPF_K, 0, 0, BPF_ACCEPT);
 
-    for (i = 0; (bufpos < (unsigned int)len); i++) {
-        key = &uevent[bufpos];
-        keylen = strlen(key);
+    /* the value is compared with the terminating NUL */
+    for (kv = udev_subsystems; kv; kv = kv->next)
+    {
+        len = strlen((char *)kv->key) + 1;
+        bpf_emit_str_test(prog, BPF_IND, strlen("SUBSYSTEM="), kv->key, len, 1);
+        bpf_emit(prog, BPF_RET | BPF_K, 0, 0, BPF_ACCEPT);
+    }
 
-        pos = strchr(key, '=');
+    bpf_emit(prog, BPF_RET | BPF_K, 0, 0, BPF_REJECT);
+}
+
+/*
+ * Matches the "ACTION@" prefix of the kernel message, and SUBSYSTEM if the
+ * rules which may match the action limit it. Returns count of the actions,
+ * filter is 0 if the program accepts all the messages.
+ */
+static int udev_kernel_prog(bpf_prog_t *prog, int subsystems, int *filter)
+{
+    char *scanned[ARRAY_SIZE(udev_actions) + 1];
+    int jumps[ARRAY_SIZE(udev_actions)];
+    char prefix[16];
+    int i, len, count = 0, scans = 0;
 
-        if (!pos)
-            break;
+    for (i = 0; i < ARRAY_SIZE(udev_actions); i++)
+    {
+        if (!events_dump && !udev_subsystem_may_match(udev_actions[i], NULL))
+            continue;
 
-        pos[0] = '\0';
-        val = &pos[1];
+        count++;
+        len = snprintf(prefix, sizeof(prefix), "%s@", udev_actions[i]);
 
-        kv = kv_set_next(kv, key, val);
+        if (events_dump || !subsystems ||
+                udev_subsystem_may_match(udev_actions[i], ""))
+        {
+            bpf_emit_str_match(prog, 0, prefix, len, BPF_ACCEPT);
+            continue;
+        }
 
-        bufpos += keylen + 1;
+        bpf_emit_str_test(prog, BPF_ABS, 0, prefix, len, 2);
+        bpf_emit(prog, BPF_LDX | BPF_IMM, 0, 0, len);
+        scanned[scans] = udev_actions[i];
+        jumps[scans++] = prog->len;
+        bpf_emit(prog, BPF_JMP | BPF_JA, 0, 0, 0);
     }
 
-    if (i > 0)
+    bpf_emit(prog, BPF_RET | BPF_K, 0, 0, BPF_REJECT);
+    *filter = count != ARRAY_SIZE(udev_actions) || scans;
+
+    if (!scans)
+        return count;
+
+    for (i = 0; i < scans; i++)
+        prog->insns[jumps[i]].k = prog->len - jumps[i] - 1;
+
+    scanned[scans] = NULL;
+    udev_subsystems_load(scanned);
+    udev_subsystem_prog(prog);
+
+    return count;
+}
+
+static void udev_attr_key_add(char *key, void *arg)
+{
+    int len = strlen(key) - strlen(UDEV_ATTR_PREFIX) - 1;
+    key_value_t *kv;
+    char *name;
+
+    if (len <= 0 || key[strlen(key) - 1] != '}')
+        return;
+
+    for (kv = udev_attrs; kv; kv = kv->next)
     {
-        kv_tmp = kv->next;
-        kv->next = NULL;
+        if (!strcmp((char *)kv->key, key))
+            return;
+    }
+
+    name = (char *)malloc(len + 1);
+    memcpy(name, key + strlen(UDEV_ATTR_PREFIX), len);
+    name[len] = '\0';
+
+    udev_attrs = key_value_add(udev_attrs, str_clone(key), name);
+}
+
+static void udev_attrs_load(void)
+{
+    key_value_free_full(udev_attrs);
+    udev_attrs = NULL;
+
+    event_rules_keys(UDEV_ATTR_PREFIX, udev_attr_key_add, NULL);
 
-        event_nlmsg_send(&kv_list);
+    if (!udev_attrs)
+        udev_attr_flush();
+}
+
+static int udev_coldplug_filter(char *subsystem)
+{
+    return events_dump || udev_subsystem_may_match(COLDPLUG_ACTION,
+            subsystem);
+}
+
+/*
+ * The devices which exist already are reported by add uevents. Scanned ones
+ * are handled in DEVPATH order before the Netlink messages, the triggered
+ * ones come from the kernel while the tree is walked.
+ */
+static void udev_coldplug_run(void)
+{
+    coldplug_msg_t *msg, *next;
+
+    if (coldplug_start(udev_coldplug, udev_coldplug_filter) ||
+            udev_coldplug != COLDPLUG_SCAN)
+    {
+        return;
+    }
 
-        kv->next = kv_tmp;
+    for (msg = coldplug_wait(); msg; msg = next)
+    {
+        next = msg->next;
+        udev_handle(udev_sock, msg->buf, msg->len, -1);
+        free(msg);
     }
 }
 
-void udev_handler_init(void)
+static void udev_rules_changed(void)
 {
-    udev_sock = nl_sock_create(NETLINK_KOBJECT_UEVENT, -1);
-    nl_sock_register_cb(udev_sock, udev_handle);
+    bpf_prog_t prog = {};
+    int count, filter, joined = 0;
+
+    udev_attrs_load();
+
+    /*
+     * subsystems registered later may match a pattern which is not literal,
+     * so SUBSYSTEM is checked only if the patterns list all the values
+     */
+    count = udev_kernel_prog(&prog, !udev_monitor &&
+            event_rules_literal("SUBSYSTEM"), &filter);
+
+    /* too many subsystems, only the actions are matched */
+    if (prog.len > BPF_MAXINSNS)
+    {
+        bpf_prog_free(&prog);
+        udev_kernel_prog(&prog, 0, &filter);
+    }
+
+    /* monitor message header has no action, only the hashes are checked */
+    if (udev_monitor && count)
+    {
+        bpf_prog_free(&prog);
+        filter = udev_monitor_prog(&prog);
+    }
+
+    /* kernel doesn't queue uevents at all if no rule can match them */
+    if (!count)
+    {
+        nl_sock_groups_set(udev_sock, 0);
+    }
+    else if (!udev_sock->addr->nl_groups)
+    {
+        /* SEQNUM gap while the group was left is not a loss */
+        udev_stats.seqnum = 0;
+        nl_sock_groups_set(udev_sock, udev_monitor ? UDEV_GROUP_MONITOR :
+                UDEV_GROUP_KERNEL);
+        joined = 1;
+    }
+
+    if (!filter)
+    {
+        bpf_prog_detach(udev_sock->sock);
+        udev_filtered = 0;
+    }
+    else
+    {
+        udev_filtered = !bpf_prog_attach(udev_sock->sock, &prog);
+    }
+
+    bpf_prog_free(&prog);
+
+    /* triggered uevents are filtered already */
+    if (joined && udev_coldplug != COLDPLUG_NONE)
+        udev_coldplug_run();
 }
 
 void udev_handler_cleanup(void)
 {
+    nlevtd_log(LOG_INFO, "Uevent: %lu overruns, %lu SEQNUM gaps, %lu missed "
+            "events\n", udev_sock ? udev_sock->rx_overruns : 0,
+            udev_stats.gaps, udev_stats.missed);
+
+    coldplug_stop();
     nl_sock_free(udev_sock);
-    key_value_free_all(kv_list.next);
+    key_value_free_full(udev_subsystems);
+    key_value_free_full(udev_attrs);
+    udev_attr_flush();
 }
 
 nl_handler_t udev_handler_ops = {
     .do_init = udev_handler_init,
     .do_cleanup = udev_handler_cleanup,
+    .do_rules_changed = udev_rules_changed,
 };
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2013 Vadim Kochan <vadim4j@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "defs.h"
+#include "uevent.h"
+
+/* variable the handler looks up, found by the key length first */
+static int uevent_key_get(char *key, int len)
+{
+    switch (len)
+    {
+        case 6:
+            if (!memcmp(key, "ACTION", 6))
+                return UEVENT_ACTION;
+            if (!memcmp(key, "SEQNUM", 6))
+                return UEVENT_SEQNUM;
+            break;
+
+        case 7:
+            if (!memcmp(key, "DEVPATH", 7))
+                return UEVENT_DEVPATH;
+            if (!memcmp(key, "DEVTYPE", 7))
+                return UEVENT_DEVTYPE;
+            break;
+
+        case 9:
+            if (!memcmp(key, "SUBSYSTEM", 9))
+                return UEVENT_SUBSYSTEM;
+            break;
+
+        case 11:
+            if (!memcmp(key, "DEVPATH_OLD", 11))
+                return UEVENT_DEVPATH_OLD;
+            break;
+    }
+
+    return -1;
+}
+
+static void uevent_var_add(uevent_t *ev, char *key, char *eq)
+{
+    key_value_t *kv = &ev->vars[ev->count];
+    int i;
+
+    if (ev->count > UEVENT_VARS_MAX)
+        return;
+
+    *eq = '\0';
+
+    kv->key = key;
+    kv->value = eq + 1;
+    kv->render = NULL;
+    kv->next = NULL;
+    kv[-1].next = kv;
+    ev->count++;
+
+    if ((i = uevent_key_get(key, eq - key)) >= 0)
+        ev->keys[i] = eq + 1;
+}
+
+/* splits KEY=VALUE\0... in place, the last variable may be not terminated */
+static void uevent_split(uevent_t *ev, char *pos, char *end)
+{
+    char *eq;
+    int len;
+
+    for (; pos < end; pos += len + 1)
+    {
+        len = strnlen(pos, end - pos);
+
+        if ((eq = memchr(pos, '=', len)))
+            uevent_var_add(ev, pos, eq);
+    }
+}
+
+/* properties of the libudev monitor message, NULL if it is malformed */
+static char *uevent_monitor_props(char *buf, int len, char **end)
+{
+    uevent_monitor_hdr_t *hdr = (uevent_monitor_hdr_t *)buf;
+
+    if (len < (int)sizeof(*hdr) || ntohl(hdr->magic) != UEVENT_MONITOR_MAGIC)
+        return NULL;
+
+    if (hdr->properties_off < sizeof(*hdr) || hdr->properties_off > len ||
+            hdr->properties_len > len - hdr->properties_off)
+    {
+        return NULL;
+    }
+
+    *end = buf + hdr->properties_off + hdr->properties_len;
+    return buf + hdr->properties_off;
+}
+
+/*
+ * Splits "ACTION@DEVPATH\0KEY=VALUE\0..." kernel message or libudev monitor
+ * message to the variables in place, the buffer should be NUL terminated.
+ * Returns count of the variables.
+ */
+int uevent_parse(uevent_t *ev, char *buf, int len)
+{
+    char *pos, *end = buf + len;
+
+    memset(ev->keys, 0, sizeof(ev->keys));
+    ev->vars[0] = (key_value_t){ .key = NL_TYPE, .value = "UEVENT" };
+    ev->count = 1;
+
+    /* kernel message starts with the action, it can't be the prefix */
+    if (!strcmp(buf, UEVENT_MONITOR_PREFIX))
+        pos = uevent_monitor_props(buf, len, &end);
+    else if ((pos = memchr(buf, '\0', len)))
+        pos++;
+
+    if (!pos)
+        return 0;
+
+    uevent_split(ev, pos, end);
+
+    return ev->count - 1;
+}
+
+/* variable rendered on use, its value is arg until then */
+void uevent_lazy_add(uevent_t *ev, char *key, char *arg,
+    char *(*render)(key_value_t *kv))
+{
+    key_value_t *kv = &ev->vars[ev->count];
+
+    if (ev->count > UEVENT_VARS_MAX)
+        return;
+
+    kv->key = key;
+    kv->value = arg;
+    kv->render = render;
+    kv->next = NULL;
+    kv[-1].next = kv;
+    ev->count++;
+}
+
+char *uevent_get(uevent_t *ev, int key)
+{
+    return ev->keys[key] ? ev->keys[key] : "";
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2013 Vadim Kochan <vadim4j@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _UEVENT_H_
+#define _UEVENT_H_
+
+#include "key_value.h"
+
+/* the kernel sends up to 64 variables, udev adds its properties */
+#define UEVENT_VARS_MAX 128
+
+/* variables which are looked up by the handler, found while splitting */
+enum
+{
+    UEVENT_ACTION,
+    UEVENT_DEVPATH,
+    UEVENT_SUBSYSTEM,
+    UEVENT_DEVTYPE,
+    UEVENT_SEQNUM,
+    UEVENT_DEVPATH_OLD,
+    UEVENT_KEYS,
+};
+
+/* udevd prefixes the properties with the header for the libudev monitors */
+#define UEVENT_MONITOR_PREFIX "libudev"
+#define UEVENT_MONITOR_MAGIC 0xfeedcafe
+
+/* magic and the hashes are in network byte order */
+typedef struct uevent_monitor_hdr
+{
+    char prefix[8];
+    unsigned int magic;
+    unsigned int header_size;
+    unsigned int properties_off;
+    unsigned int properties_len;
+    unsigned int subsystem_hash;
+    unsigned int devtype_hash;
+    unsigned int tag_bloom_hi;
+    unsigned int tag_bloom_lo;
+} uevent_monitor_hdr_t;
+
+/*
+ * Variables of the uevent as a flat array, the keys and values point into
+ * the message buffer. The first variable is NL_TYPE.
+ */
+typedef struct uevent
+{
+    int count;
+    char *keys[UEVENT_KEYS];
+    key_value_t vars[UEVENT_VARS_MAX + 1];
+} uevent_t;
+
+int uevent_parse(uevent_t *ev, char *buf, int len);
+char *uevent_get(uevent_t *ev, int key);
+void uevent_lazy_add(uevent_t *ev, char *key, char *arg,
+    char *(*render)(key_value_t *kv));
+
+#endif /* _UEVENT_H_ */
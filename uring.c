@@ -0,0 +1,448 @@
+/*
+ * Copyright (C) 2013 Vadim Kochan <vadim4j@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Minimal io_uring via the raw syscalls. The ring is set up with
+ * IORING_SETUP_DEFER_TASKRUN, so the completions are posted only while the
+ * main thread is in uring_wait and nothing changes under the handlers.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "uring.h"
+#include "log.h"
+
+static struct
+{
+    int fd;
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_array;
+    unsigned int sq_mask;
+    unsigned int sq_entries;
+    unsigned int sq_local_tail;
+    struct io_uring_sqe *sqes;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    /* buffer group ids, the ones of the freed buffer rings are reused */
+    unsigned int next_group;
+    unsigned short *free_groups;
+    unsigned int free_count;
+    uring_req_t *deferred;
+} ring = { .fd = -1 };
+
+unsigned long uring_pass = 0;
+
+static int sys_io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+    return syscall(SYS_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(unsigned int to_submit, unsigned int min_complete,
+    unsigned int flags)
+{
+    return syscall(SYS_io_uring_enter, ring.fd, to_submit, min_complete, flags,
+            NULL, 0);
+}
+
+static int sys_io_uring_register(unsigned int opcode, void *arg,
+    unsigned int nr_args)
+{
+    return syscall(SYS_io_uring_register, ring.fd, opcode, arg, nr_args);
+}
+
+int uring_init(unsigned int entries)
+{
+    struct io_uring_params p;
+    char *sq, *cq;
+
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN |
+        IORING_SETUP_CQSIZE;
+    /* multishot requests may post many completions per submission */
+    p.cq_entries = entries * 8;
+
+    if ((ring.fd = sys_io_uring_setup(entries, &p)) < 0)
+    {
+        return nlevtd_log(LOG_ERR, "Can't set up io_uring: %s\n",
+                strerror(errno));
+    }
+
+    ring.sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    ring.cq_ring_size = p.cq_off.cqes +
+        p.cq_entries * sizeof(struct io_uring_cqe);
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (ring.cq_ring_size > ring.sq_ring_size)
+            ring.sq_ring_size = ring.cq_ring_size;
+
+        ring.cq_ring_size = 0;
+    }
+
+    ring.sq_ring = mmap(NULL, ring.sq_ring_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+
+    if (ring.sq_ring == MAP_FAILED)
+        goto Error;
+
+    if (ring.cq_ring_size)
+    {
+        ring.cq_ring = mmap(NULL, ring.cq_ring_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+
+        if (ring.cq_ring == MAP_FAILED)
+            goto Error;
+    }
+    else
+    {
+        ring.cq_ring = ring.sq_ring;
+    }
+
+    ring.sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring.sqes = (struct io_uring_sqe *)mmap(NULL, ring.sqes_size,
+            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd,
+            IORING_OFF_SQES);
+
+    if (ring.sqes == MAP_FAILED)
+        goto Error;
+
+    sq = (char *)ring.sq_ring;
+    cq = (char *)ring.cq_ring;
+
+    ring.sq_head = (unsigned int *)(sq + p.sq_off.head);
+    ring.sq_tail = (unsigned int *)(sq + p.sq_off.tail);
+    ring.sq_array = (unsigned int *)(sq + p.sq_off.array);
+    ring.sq_mask = *(unsigned int *)(sq + p.sq_off.ring_mask);
+    ring.sq_entries = p.sq_entries;
+    ring.sq_local_tail = *ring.sq_tail;
+
+    ring.cq_head = (unsigned int *)(cq + p.cq_off.head);
+    ring.cq_tail = (unsigned int *)(cq + p.cq_off.tail);
+    ring.cq_mask = *(unsigned int *)(cq + p.cq_off.ring_mask);
+    ring.cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    return 0;
+
+Error:
+    nlevtd_log(LOG_ERR, "Can't map io_uring: %s\n", strerror(errno));
+    uring_cleanup();
+    return -1;
+}
+
+void uring_cleanup(void)
+{
+    if (ring.sqes && ring.sqes != MAP_FAILED)
+        munmap(ring.sqes, ring.sqes_size);
+
+    if (ring.cq_ring && ring.cq_ring != MAP_FAILED &&
+            ring.cq_ring != ring.sq_ring)
+    {
+        munmap(ring.cq_ring, ring.cq_ring_size);
+    }
+
+    if (ring.sq_ring && ring.sq_ring != MAP_FAILED)
+        munmap(ring.sq_ring, ring.sq_ring_size);
+
+    if (ring.fd >= 0)
+        close(ring.fd);
+
+    free(ring.free_groups);
+
+    memset(&ring, 0, sizeof(ring));
+    ring.fd = -1;
+}
+
+static unsigned int uring_to_submit(void)
+{
+    /* the kernel reads the entries up to the published tail */
+    __atomic_store_n(ring.sq_tail, ring.sq_local_tail, __ATOMIC_RELEASE);
+
+    return ring.sq_local_tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE);
+}
+
+static struct io_uring_sqe *uring_sqe_get(void)
+{
+    struct io_uring_sqe *sqe;
+    unsigned int idx;
+
+    /* submission queue is full, pass the entries to the kernel now */
+    if (uring_to_submit() >= ring.sq_entries)
+    {
+        sys_io_uring_enter(uring_to_submit(), 0, 0);
+
+        if (uring_to_submit() >= ring.sq_entries)
+        {
+            nlevtd_log(LOG_ERR, "io_uring submission queue is full\n");
+            return NULL;
+        }
+    }
+
+    idx = ring.sq_local_tail & ring.sq_mask;
+    sqe = &ring.sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+
+    ring.sq_array[idx] = idx;
+    ring.sq_local_tail++;
+
+    return sqe;
+}
+
+void uring_defer(uring_req_t *req)
+{
+    if (req->defer_queued)
+        return;
+
+    req->defer_queued = 1;
+    req->defer_next = ring.deferred;
+    ring.deferred = req;
+}
+
+/*
+ * Submits the queued requests and waits for at least one completion, the
+ * signals are blocked and come through the signalfd as the other fds do.
+ */
+int uring_wait(void)
+{
+    struct io_uring_cqe *cqe;
+    unsigned int head, tail;
+    uring_req_t *req;
+    int res;
+    unsigned int flags;
+
+    if (sys_io_uring_enter(uring_to_submit(), 1, IORING_ENTER_GETEVENTS) < 0 &&
+            errno != EINTR && errno != EBUSY)
+    {
+        return nlevtd_log(LOG_ERR, "io_uring_enter(): %s\n", strerror(errno));
+    }
+
+    uring_pass++;
+
+    head = *ring.cq_head;
+    tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+
+    while (head != tail)
+    {
+        cqe = &ring.cqes[head & ring.cq_mask];
+        req = (uring_req_t *)(unsigned long)cqe->user_data;
+        res = cqe->res;
+        flags = cqe->flags;
+
+        /* the entry is released before the handler may submit more */
+        __atomic_store_n(ring.cq_head, ++head, __ATOMIC_RELEASE);
+
+        if (req)
+            req->complete(req, res, flags);
+    }
+
+    while ((req = ring.deferred))
+    {
+        ring.deferred = req->defer_next;
+        req->defer_queued = 0;
+        req->deferred(req);
+    }
+
+    return 0;
+}
+
+int uring_poll(int fd, int multishot, uring_req_t *req)
+{
+    struct io_uring_sqe *sqe;
+
+    if (!(sqe = uring_sqe_get()))
+        return -1;
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = multishot ? IORING_POLL_ADD_MULTI : 0;
+    sqe->user_data = (unsigned long)req;
+
+    return 0;
+}
+
+/* the request completes with -ECANCELED, the cancel itself is not reported */
+int uring_cancel(uring_req_t *req)
+{
+    struct io_uring_sqe *sqe;
+
+    if (!(sqe = uring_sqe_get()))
+        return -1;
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = (unsigned long)req;
+    sqe->user_data = 0;
+
+    return 0;
+}
+
+/*
+ * Keeps receiving into the buffers of bufs until the completion comes without
+ * IORING_CQE_F_MORE. Each buffer starts with struct io_uring_recvmsg_out
+ * followed by the name and control space of msg and the payload.
+ */
+int uring_recvmsg_multishot(int fd, struct msghdr *msg, uring_bufs_t *bufs,
+    uring_req_t *req)
+{
+    struct io_uring_sqe *sqe;
+
+    if (!(sqe = uring_sqe_get()))
+        return -1;
+
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)msg;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = bufs->group;
+    sqe->user_data = (unsigned long)req;
+
+    return 0;
+}
+
+/* returns -1 if all the 16-bit ids are in use */
+static int uring_group_get(void)
+{
+    if (ring.free_count)
+        return ring.free_groups[--ring.free_count];
+
+    if (ring.next_group > USHRT_MAX)
+        return -1;
+
+    return ring.next_group++;
+}
+
+static void uring_group_put(unsigned short group)
+{
+    ring.free_groups = (unsigned short *)realloc(ring.free_groups,
+            (ring.free_count + 1) * sizeof(unsigned short));
+    ring.free_groups[ring.free_count++] = group;
+}
+
+/*
+ * entries should be a power of 2. Each buffer has one spare byte past the
+ * length given to the kernel so the received data may be NUL-terminated.
+ */
+uring_bufs_t *uring_bufs_create(unsigned int entries, unsigned int size)
+{
+    struct io_uring_buf_reg reg;
+    uring_bufs_t *bufs;
+    unsigned int i;
+    int group;
+
+    if ((group = uring_group_get()) < 0)
+    {
+        nlevtd_log(LOG_ERR, "No free io_uring buffer group\n");
+        return NULL;
+    }
+
+    bufs = (uring_bufs_t *)malloc(sizeof(uring_bufs_t));
+    memset(bufs, 0, sizeof(uring_bufs_t));
+
+    bufs->entries = entries;
+    bufs->size = size;
+    bufs->group = group;
+    bufs->ring = (struct io_uring_buf_ring *)mmap(NULL,
+            entries * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+            MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+
+    if (bufs->ring == MAP_FAILED)
+    {
+        uring_group_put(group);
+        free(bufs);
+        return NULL;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long)bufs->ring;
+    reg.ring_entries = entries;
+    reg.bgid = bufs->group;
+
+    if (sys_io_uring_register(IORING_REGISTER_PBUF_RING, &reg, 1))
+    {
+        nlevtd_log(LOG_ERR, "Can't register io_uring buffers: %s\n",
+                strerror(errno));
+
+        munmap(bufs->ring, entries * sizeof(struct io_uring_buf));
+        uring_group_put(group);
+        free(bufs);
+        return NULL;
+    }
+
+    bufs->mem = (char *)malloc(entries * size);
+
+    for (i = 0; i < entries; i++)
+        uring_bufs_put(bufs, i);
+
+    return bufs;
+}
+
+void uring_bufs_free(uring_bufs_t *bufs)
+{
+    struct io_uring_buf_reg reg;
+
+    if (!bufs)
+        return;
+
+    if (ring.fd >= 0)
+    {
+        memset(&reg, 0, sizeof(reg));
+        reg.bgid = bufs->group;
+        sys_io_uring_register(IORING_UNREGISTER_PBUF_RING, &reg, 1);
+
+        /* the kernel forgot the group, its id may be reused */
+        uring_group_put(bufs->group);
+    }
+
+    munmap(bufs->ring, bufs->entries * sizeof(struct io_uring_buf));
+    free(bufs->mem);
+    free(bufs);
+}
+
+void *uring_bufs_get(uring_bufs_t *bufs, unsigned int id)
+{
+    return bufs->mem + id * bufs->size;
+}
+
+/* gives the buffer back to the kernel */
+void uring_bufs_put(uring_bufs_t *bufs, unsigned int id)
+{
+    struct io_uring_buf *buf;
+
+    buf = &bufs->ring->bufs[bufs->tail & (bufs->entries - 1)];
+    buf->addr = (unsigned long)uring_bufs_get(bufs, id);
+    buf->len = bufs->size - 1;
+    buf->bid = id;
+
+    __atomic_store_n(&bufs->ring->tail, ++bufs->tail, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2013 Vadim Kochan <vadim4j@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _URING_H_
+#define _URING_H_
+
+#include <sys/socket.h>
+#include <linux/io_uring.h>
+
+#define URING_ENTRIES 256
+
+/*
+ * Submitted request, its address goes as user_data. complete is called for
+ * each completion, deferred is called once all the completions of the current
+ * wait were handled if the request was queued by uring_defer.
+ */
+typedef struct uring_req
+{
+    void (*complete)(struct uring_req *req, int res, unsigned int flags);
+    void (*deferred)(struct uring_req *req);
+    struct uring_req *defer_next;
+    int defer_queued;
+} uring_req_t;
+
+/* ring of the buffers provided to the kernel for the multishot receives */
+typedef struct uring_bufs
+{
+    struct io_uring_buf_ring *ring;
+    char *mem;
+    unsigned int entries;
+    unsigned int size;
+    unsigned short group;
+    unsigned short tail;
+} uring_bufs_t;
+
+/* number of the current uring_wait call */
+extern unsigned long uring_pass;
+
+int uring_init(unsigned int entries);
+void uring_cleanup(void);
+int uring_wait(void);
+void uring_defer(uring_req_t *req);
+
+int uring_poll(int fd, int multishot, uring_req_t *req);
+int uring_cancel(uring_req_t *req);
+int uring_recvmsg_multishot(int fd, struct msghdr *msg, uring_bufs_t *bufs,
+    uring_req_t *req);
+
+uring_bufs_t *uring_bufs_create(unsigned int entries, unsigned int size);
+void uring_bufs_free(uring_bufs_t *bufs);
+void *uring_bufs_get(uring_bufs_t *bufs, unsigned int id);
+void uring_bufs_put(uring_bufs_t *bufs, unsigned int id);
+
+#endif /* _URING_H_ */
@@ -18,17 +18,6 @@
 #include <stdlib.h>
 #include <string.h>
 
-char *itoa(int val)
-{
-    static char buf[32] = {0};
-
-    int i = 30;
-    for (; val && i; --i, val /= 10)
-        buf[i] = "0123456789"[val % 10];
-
-    return &buf[i + 1];
-}
-
 char *str_clone(char *s)
 {
     char *clone;
@@ -46,3 +35,78 @@ int str_is_empty(char *s)
 {
     return !s || *s  == '\0' || strlen(s) == 0;
 }
+
+/* FNV-1a */
+unsigned int mem_hash(void *data, int len)
+{
+    unsigned char *s = (unsigned char *)data;
+    unsigned int hash = 2166136261u;
+
+    while (len--)
+        hash = (hash ^ *s++) * 16777619u;
+
+    return hash;
+}
+
+/* MurmurHash2, libudev hashes the subsystem and devtype with seed 0 */
+unsigned int murmur_hash2(void *data, int len, unsigned int seed)
+{
+    const unsigned int m = 0x5bd1e995;
+    unsigned char *s = (unsigned char *)data;
+    unsigned int hash = seed ^ len;
+    unsigned int k;
+
+    for (; len >= 4; s += 4, len -= 4)
+    {
+        memcpy(&k, s, 4);
+        k *= m;
+        k ^= k >> 24;
+        k *= m;
+        hash = (hash * m) ^ k;
+    }
+
+    switch (len)
+    {
+        case 3:
+            hash ^= s[2] << 16;
+            /* fall through */
+        case 2:
+            hash ^= s[1] << 8;
+            /* fall through */
+        case 1:
+            hash ^= s[0];
+            hash *= m;
+    }
+
+    hash ^= hash >> 13;
+    hash *= m;
+    hash ^= hash >> 15;
+
+    return hash;
+}
+
+/* parses size with optional K/M suffix, returns -1 on error */
+long str_to_size(char *s)
+{
+    char *end;
+    long size = strtol(s, &end, 10);
+
+    if (end == s || size < 0)
+        return -1;
+
+    switch (*end)
+    {
+        case 'k':
+        case 'K':
+            size *= 1024;
+            end++;
+            break;
+        case 'm':
+        case 'M':
+            size *= 1024 * 1024;
+            end++;
+            break;
+    }
+
+    return *end ? -1 : size;
+}
@@ -20,8 +20,10 @@
 
 #define ARRAY_SIZE(array) (sizeof(array) / sizeof(array[0])) 
 
-char *itoa(int val);
 char *str_clone(char *s);
 int str_is_empty(char *s);
+long str_to_size(char *s);
+unsigned int mem_hash(void *data, int len);
+unsigned int murmur_hash2(void *data, int len, unsigned int seed);
 
 #endif /* _UTILS_H_ */
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2013 Vadim Kochan <vadim4j@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Pool of the worker threads. Jobs are distributed over the lanes by the
+ * object hash, each lane is handled by a single worker at a time, so the jobs
+ * of the same object keep their order. Worker prefers its own lanes and
+ * steals the pending lanes of the busy workers when its own are empty.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include "workers.h"
+#include "log.h"
+
+typedef struct lane
+{
+    work_t *head;
+    work_t *tail;
+    int busy;
+} lane_t;
+
+typedef struct worker
+{
+    pthread_t tid;
+    int id;
+    unsigned long jobs;
+    unsigned long steals;
+} worker_t;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static lane_t *lanes = NULL;
+static int lanes_count = 0;
+static worker_t *workers = NULL;
+static int workers_count = 0;
+static int stopping = 0;
+static void (*work_func)(work_t *work);
+
+/* looks for the pending lane which is not handled by other worker */
+static lane_t *lane_pick(worker_t *w)
+{
+    int i, count = lanes_count / WORKERS_LANES_PER_WORKER;
+    lane_t *lane;
+
+    /*
+     * own lanes are i % count == w->id, workers_count is not used as the
+     * worker may start before it is counted
+     */
+    for (i = w->id; i < lanes_count; i += count)
+    {
+        lane = &lanes[i];
+
+        if (lane->head && !lane->busy)
+            return lane;
+    }
+
+    for (i = 0; i < lanes_count; i++)
+    {
+        lane = &lanes[i];
+
+        if (lane->head && !lane->busy)
+        {
+            w->steals++;
+            return lane;
+        }
+    }
+
+    return NULL;
+}
+
+static void *worker_run(void *arg)
+{
+    worker_t *w = (worker_t *)arg;
+    work_t *work;
+    lane_t *lane;
+    sigset_t sigs;
+
+    /* signals are handled by the main thread */
+    sigfillset(&sigs);
+    pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+
+    pthread_mutex_lock(&lock);
+
+    for (;;)
+    {
+        if (!(lane = lane_pick(w)))
+        {
+            if (stopping)
+                break;
+
+            pthread_cond_wait(&cond, &lock);
+            continue;
+        }
+
+        /* take all the pending jobs of the lane at once */
+        work = lane->head;
+        lane->head = lane->tail = NULL;
+        lane->busy = 1;
+
+        pthread_mutex_unlock(&lock);
+
+        while (work)
+        {
+            work_t *next = work->next;
+
+            work_func(work);
+            w->jobs++;
+            work = next;
+        }
+
+        pthread_mutex_lock(&lock);
+
+        lane->busy = 0;
+
+        /* new jobs could be queued to the lane while it was busy */
+        if (lane->head)
+            pthread_cond_signal(&cond);
+    }
+
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+int workers_init(int count, void (*func)(work_t *work))
+{
+    int i;
+
+    work_func = func;
+    lanes_count = count * WORKERS_LANES_PER_WORKER;
+    lanes = (lane_t *)calloc(lanes_count, sizeof(lane_t));
+    workers = (worker_t *)calloc(count, sizeof(worker_t));
+
+    for (i = 0; i < count; i++)
+    {
+        workers[i].id = i;
+
+        if ((errno = pthread_create(&workers[i].tid, NULL, worker_run,
+                        &workers[i])))
+        {
+            return nlevtd_log(LOG_ERR, "Can't start worker thread: %s\n",
+                    strerror(errno));
+        }
+
+        workers_count++;
+    }
+
+    return 0;
+}
+
+void workers_queue(unsigned int hash, work_t *work)
+{
+    lane_t *lane = &lanes[hash % lanes_count];
+
+    work->next = NULL;
+
+    pthread_mutex_lock(&lock);
+
+    if (lane->tail)
+        lane->tail->next = work;
+    else
+        lane->head = work;
+
+    lane->tail = work;
+
+    /* busy lane will be rechecked by its worker */
+    if (!lane->busy)
+        pthread_cond_signal(&cond);
+
+    pthread_mutex_unlock(&lock);
+}
+
+/* waits until the queued jobs are done */
+void workers_cleanup(void)
+{
+    int i;
+
+    if (!workers)
+        return;
+
+    pthread_mutex_lock(&lock);
+    stopping = 1;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&lock);
+
+    for (i = 0; i < workers_count; i++)
+    {
+        pthread_join(workers[i].tid, NULL);
+
+        nlevtd_log(LOG_INFO, "Worker %d: %lu jobs, %lu steals\n", i,
+                workers[i].jobs, workers[i].steals);
+    }
+
+    free(workers);
+    free(lanes);
+    workers = NULL;
+    lanes = NULL;
+    workers_count = lanes_count = 0;
+    stopping = 0;
+}
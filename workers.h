@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2013 Vadim Kochan <vadim4j@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _WORKERS_H_
+#define _WORKERS_H_
+
+/* lanes per worker, jobs of the same lane are handled in order */
+#define WORKERS_LANES_PER_WORKER 8
+
+/* should be the first member of the job */
+typedef struct work
+{
+    struct work *next;
+} work_t;
+
+int workers_init(int count, void (*func)(work_t *work));
+void workers_queue(unsigned int hash, work_t *work);
+void workers_cleanup(void);
+
+#endif /* _WORKERS_H_ */